@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2026 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause OR MIT
+ */
+
+#include "effect_cache.hpp"
+#include "dll_log.hpp"
+#include <chrono>
+#include <cassert>
+#include <cstring> // std::memcpy
+#include <algorithm> // std::sort
+#include <Windows.h>
+
+// Archive layout: header, followed by the index of all entries, followed by the entry data
+static constexpr uint32_t s_archive_magic = 0x43465852; // "RXFC"
+static constexpr uint32_t s_archive_version = 1;
+
+struct archive_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entry_count;
+	uint32_t reserved;
+};
+struct archive_entry
+{
+	uint64_t offset;
+	uint64_t size;
+	uint64_t last_access;
+	uint32_t key_size;
+	// Followed by key characters
+};
+
+static std::mutex s_effect_cache_mutex;
+static std::unordered_map<std::filesystem::path::string_type, std::unique_ptr<reshade::effect_cache>> s_effect_cache;
+
+static uint64_t current_access_time()
+{
+	return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+reshade::effect_cache::effect_cache(const std::filesystem::path &path) : _path(path)
+{
+	if (!map_file())
+		return;
+
+	// Read index of the existing archive
+	size_t offset = 0;
+	archive_header header;
+	if (_file_view_size < sizeof(header))
+		goto invalid_archive;
+	std::memcpy(&header, _file_view, sizeof(header));
+	offset += sizeof(header);
+
+	if (header.magic != s_archive_magic || header.version != s_archive_version)
+		goto invalid_archive;
+
+	for (uint32_t i = 0; i < header.entry_count; ++i)
+	{
+		archive_entry info;
+		if (_file_view_size - offset < sizeof(info))
+			goto invalid_archive;
+		std::memcpy(&info, _file_view + offset, sizeof(info));
+		offset += sizeof(info);
+
+		if (_file_view_size - offset < info.key_size || info.offset > _file_view_size || _file_view_size - info.offset < info.size)
+			goto invalid_archive;
+
+		entry &e = _entries[std::string(reinterpret_cast<const char *>(_file_view) + offset, info.key_size)];
+		e.offset = info.offset;
+		e.size = info.size;
+		e.last_access = info.last_access;
+		offset += info.key_size;
+	}
+	return;
+
+invalid_archive:
+	log::message(log::level::warning, "Effect cache archive '%s' is invalid or was created by a different version and will be replaced.", _path.u8string().c_str());
+
+	_entries.clear();
+	unmap_file();
+}
+reshade::effect_cache::~effect_cache()
+{
+	unmap_file();
+}
+
+void reshade::effect_cache::set_size_limit(uint64_t size_limit)
+{
+	const std::unique_lock<std::mutex> lock(_mutex);
+
+	_size_limit = size_limit;
+}
+
+bool reshade::effect_cache::load(const std::string &key, std::string &data)
+{
+	const std::unique_lock<std::mutex> lock(_mutex);
+
+	const auto it = _entries.find(key);
+	if (it == _entries.end())
+		return false;
+
+	// Access time is only written to disk together with other changes during the next flush, to avoid rewriting the archive just because of a read
+	entry &e = it->second;
+	e.last_access = current_access_time();
+
+	if (e.pending)
+		data = e.pending_data;
+	else
+		data.assign(reinterpret_cast<const char *>(_file_view) + e.offset, static_cast<size_t>(e.size));
+	return true;
+}
+void reshade::effect_cache::save(const std::string &key, const std::string &data)
+{
+	const std::unique_lock<std::mutex> lock(_mutex);
+
+	entry &e = _entries[key];
+	e.size = data.size();
+	e.last_access = current_access_time();
+	e.pending_data = data;
+	e.pending = true;
+
+	_modified = true;
+}
+
+bool reshade::effect_cache::flush()
+{
+	const std::unique_lock<std::mutex> lock(_mutex);
+
+	if (!_modified)
+		return true;
+
+	// Evict least recently used entries until the archive fits into the size limit again
+	std::vector<std::pair<const std::string, entry> *> sorted_entries;
+	sorted_entries.reserve(_entries.size());
+	for (std::pair<const std::string, entry> &e : _entries)
+		sorted_entries.push_back(&e);
+	std::sort(sorted_entries.begin(), sorted_entries.end(),
+		[](const std::pair<const std::string, entry> *lhs, const std::pair<const std::string, entry> *rhs) {
+			return lhs->second.last_access > rhs->second.last_access;
+		});
+
+	uint64_t total_size = sizeof(archive_header);
+	size_t num_entries = 0;
+	for (; num_entries < sorted_entries.size(); ++num_entries)
+	{
+		const uint64_t entry_size = sizeof(archive_entry) + sorted_entries[num_entries]->first.size() + sorted_entries[num_entries]->second.size;
+		if (total_size + entry_size > _size_limit)
+			break;
+		total_size += entry_size;
+	}
+
+	std::vector<std::string> evicted_keys;
+	for (size_t i = num_entries; i < sorted_entries.size(); ++i)
+		evicted_keys.push_back(sorted_entries[i]->first);
+	sorted_entries.resize(num_entries);
+
+	// Write new archive to a temporary file first and then replace the existing one, so that a failure cannot leave behind a corrupted archive
+	std::filesystem::path temp_path = _path;
+	temp_path += L".tmp";
+
+	FILE *const file = _wfsopen(temp_path.c_str(), L"wb", SH_DENYWR);
+	if (file == nullptr)
+		return false;
+
+	const archive_header header = { s_archive_magic, s_archive_version, static_cast<uint32_t>(sorted_entries.size()), 0 };
+	fwrite(&header, sizeof(header), 1, file);
+
+	uint64_t data_offset = sizeof(header);
+	for (const std::pair<const std::string, entry> *e : sorted_entries)
+		data_offset += sizeof(archive_entry) + e->first.size();
+
+	std::vector<uint64_t> new_offsets;
+	new_offsets.reserve(sorted_entries.size());
+	for (const std::pair<const std::string, entry> *e : sorted_entries)
+	{
+		const archive_entry info = { data_offset, e->second.size, e->second.last_access, static_cast<uint32_t>(e->first.size()) };
+		fwrite(&info, sizeof(info), 1, file);
+		fwrite(e->first.data(), 1, e->first.size(), file);
+
+		new_offsets.push_back(data_offset);
+		data_offset += e->second.size;
+	}
+
+	for (const std::pair<const std::string, entry> *e : sorted_entries)
+	{
+		if (e->second.pending)
+			fwrite(e->second.pending_data.data(), 1, e->second.pending_data.size(), file);
+		else
+			fwrite(_file_view + e->second.offset, 1, static_cast<size_t>(e->second.size), file);
+	}
+
+	const bool write_success = ferror(file) == 0;
+	fclose(file);
+
+	std::error_code ec;
+	if (!write_success)
+	{
+		std::filesystem::remove(temp_path, ec);
+		return false;
+	}
+
+	// Cannot replace a file that is still mapped, so unmap the old archive first
+	unmap_file();
+
+	std::filesystem::rename(temp_path, _path, ec);
+	if (ec)
+	{
+		log::message(log::level::error, "Failed to write effect cache archive '%s' with error code %d!", _path.u8string().c_str(), ec.value());
+
+		std::filesystem::remove(temp_path, ec);
+
+		// Old archive is still intact, so can continue to use it and try writing again during the next flush
+		map_file();
+		return false;
+	}
+
+	for (size_t i = 0; i < sorted_entries.size(); ++i)
+	{
+		entry &e = sorted_entries[i]->second;
+		e.offset = new_offsets[i];
+		e.pending = false;
+		e.pending_data.clear();
+		e.pending_data.shrink_to_fit();
+	}
+
+	for (const std::string &key : evicted_keys)
+		_entries.erase(key);
+
+	_modified = false;
+
+	if (!map_file())
+	{
+		// Without a mapping there is no data to back the entries anymore
+		_entries.clear();
+		return false;
+	}
+
+	return true;
+}
+bool reshade::effect_cache::clear()
+{
+	const std::unique_lock<std::mutex> lock(_mutex);
+
+	_entries.clear();
+	_modified = false;
+
+	unmap_file();
+
+	std::error_code ec;
+	std::filesystem::remove(_path, ec);
+	return !ec;
+}
+
+bool reshade::effect_cache::map_file()
+{
+	assert(_file_mapping == nullptr && _file_view == nullptr);
+
+	const HANDLE file = CreateFileW(_path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size = {};
+	// Cannot create a mapping of an empty file
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	// The mapping holds its own reference to the file, so can close the file handle right away
+	const HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (mapping == nullptr)
+		return false;
+
+	const void *const view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	_file_mapping = mapping;
+	_file_view = static_cast<const uint8_t *>(view);
+	_file_view_size = static_cast<uint64_t>(file_size.QuadPart);
+
+	return true;
+}
+void reshade::effect_cache::unmap_file()
+{
+	if (_file_view != nullptr)
+		UnmapViewOfFile(_file_view);
+	if (_file_mapping != nullptr)
+		CloseHandle(_file_mapping);
+
+	_file_mapping = nullptr;
+	_file_view = nullptr;
+	_file_view_size = 0;
+}
+
+reshade::effect_cache &reshade::effect_cache::load_cache(const std::filesystem::path &path)
+{
+	assert(!path.empty() && path.is_absolute());
+
+	const std::unique_lock<std::mutex> lock(s_effect_cache_mutex);
+
+	const auto insert = s_effect_cache.try_emplace(path);
+	const auto it = insert.first;
+
+	// Only construct when actually adding a new entry to the cache, since the 'effect_cache' constructor performs a costly read of the index
+	if (insert.second)
+		it->second = std::make_unique<effect_cache>(path);
+
+	return *it->second;
+}
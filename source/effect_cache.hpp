@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2026 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause OR MIT
+ */
+
+#pragma once
+
+#include <mutex>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <unordered_map>
+
+namespace reshade
+{
+	/// <summary>
+	/// Computes a 64-bit FNV-1a hash of the specified <paramref name="data"/>.
+	/// </summary>
+	/// <param name="hash">Hash value to continue from, in order to combine multiple blocks of data into a single hash.</param>
+	inline uint64_t hash_data(const void *data, size_t size, uint64_t hash = 14695981039346656037ull)
+	{
+		for (size_t i = 0; i < size; ++i)
+			hash = (hash ^ static_cast<const uint8_t *>(data)[i]) * 1099511628211ull;
+		return hash;
+	}
+	inline uint64_t hash_data(const std::string_view data, uint64_t hash = 14695981039346656037ull)
+	{
+		return hash_data(data.data(), data.size(), hash);
+	}
+
+	/// <summary>
+	/// A single packed archive of cached effect data (preprocessed source code, compiled shader modules, ...), indexed by a string key.
+	/// The archive file is memory-mapped for reading. New entries are kept in memory until <see cref="flush"/> writes them out.
+	/// </summary>
+	class effect_cache
+	{
+	public:
+		/// <summary>
+		/// Opens the archive file at the specified <paramref name="path"/>.
+		/// </summary>
+		/// <param name="path">Path to the archive file to access.</param>
+		explicit effect_cache(const std::filesystem::path &path);
+		~effect_cache();
+
+		/// <summary>
+		/// Gets the path to this archive file.
+		/// </summary>
+		const std::filesystem::path &path() const { return _path; }
+
+		/// <summary>
+		/// Sets the maximum size of the archive in bytes, past which the least recently used entries are evicted during the next <see cref="flush"/>.
+		/// </summary>
+		void set_size_limit(uint64_t size_limit);
+
+		/// <summary>
+		/// Gets the data of the entry with the specified <paramref name="key"/>.
+		/// </summary>
+		/// <param name="data">Reference filled with the data of this entry.</param>
+		/// <returns><see langword="true"/> if the entry exists, <see langword="false"/> otherwise.</returns>
+		bool load(const std::string &key, std::string &data);
+		/// <summary>
+		/// Adds or replaces the entry with the specified <paramref name="key"/>.
+		/// </summary>
+		void save(const std::string &key, const std::string &data);
+
+		/// <summary>
+		/// Writes all changes to disk, replacing the archive file.
+		/// </summary>
+		bool flush();
+		/// <summary>
+		/// Removes all entries and deletes the archive file.
+		/// </summary>
+		bool clear();
+
+		/// <summary>
+		/// Gets the specified archive from cache or opens it when it was not cached yet.
+		/// </summary>
+		/// <param name="path">Absolute path to the archive file to access.</param>
+		/// <returns>Reference to the cached archive.</returns>
+		static effect_cache &load_cache(const std::filesystem::path &path);
+
+	private:
+		struct entry
+		{
+			uint64_t offset = 0;
+			uint64_t size = 0;
+			uint64_t last_access = 0;
+			std::string pending_data;
+			bool pending = false;
+		};
+
+		bool map_file();
+		void unmap_file();
+
+		const std::filesystem::path _path;
+		std::mutex _mutex;
+		uint64_t _size_limit = std::numeric_limits<uint64_t>::max();
+		std::unordered_map<std::string, entry> _entries;
+		bool _modified = false;
+		void *_file_mapping = nullptr;
+		const uint8_t *_file_view = nullptr;
+		uint64_t _file_view_size = 0;
+	};
+}
@@ -7,7 +7,8 @@
 
 #include "effect_module.hpp"
 #include <memory> // std::unique_ptr
-#include <algorithm> // std::find_if
+#include <cassert>
+#include <unordered_map>
 
 namespace reshadefx
 {
@@ -41,6 +42,13 @@ namespace reshadefx
 		/// <param name="assembly">Output assembly code.</param>
 		/// <param name="errors">Output list of error messages.</param>
 		virtual bool assemble_code_for_entry_point(const std::string &entry_point_name, std::string &binary, std::string &assembly, std::string &errors) const = 0;
+		/// <summary>
+		/// Computes a hash of the code that is assembled for the specified entry point, which only changes when code actually referenced by that entry point changes.
+		/// This can be used to reuse previously assembled entry points after unrelated parts of the effect were modified.
+		/// </summary>
+		/// <param name="entry_point_name">Name of the entry point function to compute the hash for.</param>
+		/// <returns>Hash of the entry point code, or zero if this is not supported and the entire module has to be considered instead.</returns>
+		virtual size_t hash_code_for_entry_point(const std::string &) const { return 0; }
 
 	protected:
 		/// <summary>
@@ -321,9 +329,11 @@ namespace reshadefx
 		/// <returns>Reference to the struct description.</returns>
 		const struct_type &get_struct(id id) const
 		{
-			const auto it = std::find_if(_structs.begin(), _structs.end(),
-				[id](const struct_type &info) { return info.id == id; });
-			return *it;
+			return _structs[find_index(_struct_lookup, _structs, id)];
+		}
+		const struct_type &get_struct(id id)
+		{
+			return _structs[update_and_find_index(_struct_lookup, _structs, id)];
 		}
 		/// <summary>
 		/// Looks up an existing texture object.
@@ -332,9 +342,7 @@ namespace reshadefx
 		/// <returns>Reference to the texture description.</returns>
 		texture &get_texture(id id)
 		{
-			const auto it = std::find_if(_module.textures.begin(), _module.textures.end(),
-				[id](const texture &info) { return info.id == id; });
-			return *it;
+			return _module.textures[update_and_find_index(_texture_lookup, _module.textures, id)];
 		}
 		/// <summary>
 		/// Looks up an existing sampler object.
@@ -343,9 +351,7 @@ namespace reshadefx
 		/// <returns>Reference to the sampler description.</returns>
 		sampler &get_sampler(id id)
 		{
-			const auto it = std::find_if(_module.samplers.begin(), _module.samplers.end(),
-				[id](const sampler &info) { return info.id == id; });
-			return *it;
+			return _module.samplers[update_and_find_index(_sampler_lookup, _module.samplers, id)];
 		}
 		/// <summary>
 		/// Looks up an existing storage object.
@@ -354,9 +360,7 @@ namespace reshadefx
 		/// <returns>Reference to the storage description.</returns>
 		storage &get_storage(id id)
 		{
-			const auto it = std::find_if(_module.storages.begin(), _module.storages.end(),
-				[id](const storage &info) { return info.id == id; });
-			return *it;
+			return _module.storages[update_and_find_index(_storage_lookup, _module.storages, id)];
 		}
 		/// <summary>
 		/// Looks up an existing function definition.
@@ -365,19 +369,28 @@ namespace reshadefx
 		/// <returns>Reference to the function description.</returns>
 		function &get_function(id id)
 		{
-			const auto it = std::find_if(_functions.begin(), _functions.end(),
-				[id](const std::unique_ptr<function> &info) { return info->id == id; });
-			return *it->get();
+			return *_functions[update_and_find_index(_function_lookup, _functions, id)];
 		}
 		function *find_function(const std::string &unique_name)
 		{
-			const auto it = std::find_if(_functions.begin(), _functions.end(),
-				[&unique_name](const std::unique_ptr<function> &info) { return info->unique_name == unique_name; });
-			return it != _functions.end() ? it->get() : nullptr;
+			// Index any functions that were added since the last lookup
+			for (; _function_name_lookup_size < _functions.size(); ++_function_name_lookup_size)
+				_function_name_lookup.emplace(_functions[_function_name_lookup_size]->unique_name, _function_name_lookup_size);
+
+			const auto it = _function_name_lookup.find(unique_name);
+			return it != _function_name_lookup.end() ? _functions[it->second].get() : nullptr;
 		}
 		const function *find_function(const std::string &unique_name) const
 		{
-			return const_cast<codegen *>(this)->find_function(unique_name);
+			// Do not modify the index here, so that this can be called concurrently (e.g. when assembling multiple entry points in parallel)
+			if (const auto it = _function_name_lookup.find(unique_name);
+				it != _function_name_lookup.end())
+				return _functions[it->second].get();
+
+			for (size_t i = _function_name_lookup_size; i < _functions.size(); ++i)
+				if (_functions[i]->unique_name == unique_name)
+					return _functions[i].get();
+			return nullptr;
 		}
 
 		id make_id() { return _next_id++; }
@@ -390,6 +403,56 @@ namespace reshadefx
 		id _last_block = 0;
 		id _current_block = 0;
 		function *_current_function = nullptr;
+
+	private:
+		/// <summary>
+		/// Maps SSA IDs to indices into one of the lists above.
+		/// Back-ends only ever append to those lists, so the index is brought up to date lazily on lookup, rather than requiring every definition to register itself.
+		/// Lookups through a constant code generator never modify the index and instead search any elements that were not indexed yet linearly, so that they are safe to call concurrently.
+		/// </summary>
+		struct id_lookup
+		{
+			std::unordered_map<id, size_t> indices;
+			size_t size = 0;
+		};
+
+		static id get_id(const std::unique_ptr<function> &info) { return info->id; }
+		template <typename T>
+		static id get_id(const T &info) { return info.id; }
+
+		template <typename T>
+		static size_t find_index(const id_lookup &lookup, const std::vector<T> &list, id id)
+		{
+			if (const auto it = lookup.indices.find(id);
+				it != lookup.indices.end())
+				return it->second;
+
+			for (size_t i = lookup.size; i < list.size(); ++i)
+				if (get_id(list[i]) == id)
+					return i;
+
+			assert(false);
+			return list.size();
+		}
+		template <typename T>
+		static size_t update_and_find_index(id_lookup &lookup, const std::vector<T> &list, id id)
+		{
+			// Index any elements that were added since the last lookup (keeping the first element in case of duplicates, same as a linear search would)
+			for (; lookup.size < list.size(); ++lookup.size)
+				lookup.indices.emplace(get_id(list[lookup.size]), lookup.size);
+
+			const auto it = lookup.indices.find(id);
+			assert(it != lookup.indices.end());
+			return it->second;
+		}
+
+		id_lookup _struct_lookup;
+		id_lookup _texture_lookup;
+		id_lookup _sampler_lookup;
+		id_lookup _storage_lookup;
+		id_lookup _function_lookup;
+		std::unordered_map<std::string, size_t> _function_name_lookup;
+		size_t _function_name_lookup_size = 0;
 	};
 
 	/// <summary>
@@ -418,5 +481,13 @@ namespace reshadefx
 	/// <param name="uniforms_to_spec_constants">Whether to convert uniform variables to specialization constants.</param>
 	/// <param name="enable_16bit_types">Use real 16-bit types for the minimum precision types "min16int", "min16uint" and "min16float".</param>
 	/// <param name="flip_vert_y">Insert code to flip the Y component of the output position in vertex shaders.</param>
-	codegen *create_codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types = false, bool flip_vert_y = false);
+	/// <param name="optimization_level">Optimization level applied to the code assembled for each entry point (see <see cref="optimize_spirv"/>), or -1 to disable optimization.</param>
+	codegen *create_codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types = false, bool flip_vert_y = false, int optimization_level = -1);
+
+	/// <summary>
+	/// Optimizes a SPIR-V module containing a single entry point, as assembled by the SPIR-V code generation back-end.
+	/// </summary>
+	/// <param name="spirv">SPIR-V module to optimize in place.</param>
+	/// <param name="optimization_level">0 or 1 - strip functions, variables, types and instructions not needed by the entry point, 2 or higher - also fold constants and forward stored and loaded values within basic blocks.</param>
+	void optimize_spirv(std::string &spirv, int optimization_level);
 }
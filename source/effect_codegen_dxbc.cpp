@@ -111,6 +111,16 @@ public:
 		return SUCCEEDED(hr);
 	}
 
+	size_t hash_code_for_entry_point(const std::string &entry_point_name) const override
+	{
+		const size_t hash = codegen_hlsl::hash_code_for_entry_point(entry_point_name);
+		if (hash == 0)
+			return 0;
+
+		// The optimization level can be changed by a pragma in the effect, without affecting the generated code
+		return hash ^ (std::hash<int>()(_optimization_level) + 0x9e3779b9 + (hash << 6) + (hash >> 2));
+	}
+
 	void emit_pragma(const std::string &pragma) override
 	{
 		if (pragma == "reshade skipoptimization" || pragma == "reshade nooptimization")
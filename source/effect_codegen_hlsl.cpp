@@ -10,6 +10,7 @@
 #include <cassert>
 #include <cstring> // stricmp, std::memcmp
 #include <charconv> // std::from_chars, std::to_chars
+#include <string_view>
 #include <algorithm> // std::equal, std::find, std::find_if, std::max
 
 using namespace reshadefx;
@@ -408,6 +409,49 @@ protected:
 
 		return true;
 	}
+	size_t hash_code_for_entry_point(const std::string &entry_point_name) const override
+	{
+		std::string code;
+		if (!codegen_hlsl::assemble_code_for_entry_point(entry_point_name, code, code, code))
+			return 0;
+
+		const auto is_identifier_char = [](char c) {
+			return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
+		};
+
+		// Automatically generated names and the suffixes added to duplicate names are derived from IDs, which are allocated in order for the entire effect, so any change to an earlier function would change them here too
+		// Renumber them in order of appearance, so that the hash only depends on the code of this entry point
+		std::string canonical_code;
+		canonical_code.reserve(code.size());
+		std::unordered_map<std::string_view, size_t> renumbered_ids;
+
+		for (size_t offset = 0; offset < code.size();)
+		{
+			if (!is_identifier_char(code[offset]))
+			{
+				canonical_code += code[offset++];
+				continue;
+			}
+
+			const size_t name_offset = offset;
+			while (offset < code.size() && is_identifier_char(code[offset]))
+				offset++;
+
+			const std::string_view name(code.data() + name_offset, offset - name_offset);
+			if (const size_t suffix_offset = name.rfind('_') + 1;
+				suffix_offset != 0 && suffix_offset < name.size() && name.find_first_not_of("0123456789", suffix_offset) == std::string_view::npos)
+			{
+				canonical_code += name.substr(0, suffix_offset);
+				canonical_code += std::to_string(renumbered_ids.emplace(name.substr(suffix_offset), renumbered_ids.size()).first->second);
+			}
+			else
+			{
+				canonical_code += name;
+			}
+		}
+
+		return std::hash<std::string>()(canonical_code);
+	}
 
 	template <bool is_param = false, bool is_decl = true>
 	void write_type(std::string &s, const type &type, texture_format format = texture_format::unknown) const
@@ -6,9 +6,9 @@
 #include "effect_parser.hpp"
 #include "effect_codegen.hpp"
 #include <cassert>
-#include <cstring> // std::memcmp
+#include <cstring> // std::memcmp, std::memcpy, std::strlen
 #include <charconv> // std::from_chars
-#include <algorithm> // std::find_if, std::max, std::sort
+#include <algorithm> // std::find_if, std::max, std::rotate, std::sort
 #include <unordered_set>
 
 // Use the C++ variant of the SPIR-V headers
@@ -25,26 +25,143 @@ inline uint32_t align_up(uint32_t size, uint32_t alignment)
 	return ((size + alignment) & ~alignment);
 }
 
+inline void hash_combine(size_t &seed, size_t v)
+{
+	seed ^= v + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+inline size_t hash_type(const reshadefx::type &type)
+{
+	// Only hash the fields that are compared by the equality operator of 'type' (qualifiers are ignored)
+	size_t seed = (static_cast<size_t>(type.base) << 8) | (type.rows << 4) | type.cols;
+	hash_combine(seed, type.array_length);
+	hash_combine(seed, type.struct_definition);
+	return seed;
+}
+
+struct spirv_instruction;
+
+/// <summary>
+/// A read-only view of a single instruction in a SPIR-V module
+/// </summary>
+struct spirv_instruction_view
+{
+	const uint32_t *words;
+	uint32_t first_operand; // Index of the first operand word, which depends on whether the instruction has a type and result
+
+	spv::Op op() const { return static_cast<spv::Op>(words[0] & spv::OpCodeMask); }
+	uint32_t word_count() const { return words[0] >> spv::WordCountShift; }
+
+	spv::Id type() const { return first_operand > 2 ? words[1] : 0; }
+	spv::Id result() const { return first_operand > 1 ? words[first_operand - 1] : 0; }
+
+	size_t operand_count() const { return word_count() - first_operand; }
+	const uint32_t *operands() const { return words + first_operand; }
+
+	/// <summary>
+	/// Write this instruction to a SPIR-V module.
+	/// </summary>
+	/// <param name="output">The output stream to append this instruction to.</param>
+	void write(std::basic_string<char> &output) const
+	{
+		output.append(reinterpret_cast<const char *>(words), word_count() * sizeof(uint32_t));
+	}
+};
+
+/// <summary>
+/// A list of instructions forming a basic block in the SPIR-V module
+/// Instructions are stored as a flat stream of words in the same layout they are written to the module, so that appending blocks or writing them out only needs to copy a single range of memory.
+/// </summary>
+struct spirv_basic_block
+{
+	struct instruction_offset
+	{
+		uint32_t offset;
+		uint32_t first_operand;
+	};
+
+	std::vector<uint32_t> words;
+	std::vector<instruction_offset> instructions;
+
+	bool empty() const { return instructions.empty(); }
+	size_t size() const { return instructions.size(); }
+
+	spirv_instruction_view operator[](size_t index) const
+	{
+		assert(index < instructions.size());
+		return { words.data() + instructions[index].offset, instructions[index].first_operand };
+	}
+	spirv_instruction_view back() const
+	{
+		return operator[](instructions.size() - 1);
+	}
+
+	/// <summary>
+	/// Remove the last instruction from this block.
+	/// </summary>
+	void pop_back()
+	{
+		words.resize(instructions.back().offset);
+		instructions.pop_back();
+	}
+
+	/// <summary>
+	/// Append a new instruction to the end of this block.
+	/// </summary>
+	spirv_instruction add_instruction(spv::Op op, spv::Id type = 0, spv::Id result = 0);
+
+	/// <summary>
+	/// Append another basic block the end of this one.
+	/// </summary>
+	void append(const spirv_basic_block &block)
+	{
+		const uint32_t base_offset = static_cast<uint32_t>(words.size());
+
+		words.insert(words.end(), block.words.begin(), block.words.end());
+
+		instructions.reserve(instructions.size() + block.instructions.size());
+		for (const instruction_offset &inst : block.instructions)
+			instructions.push_back({ base_offset + inst.offset, inst.first_operand });
+	}
+
+	/// <summary>
+	/// Move the instruction at the specified <paramref name="index"/> behind all other instructions in this block.
+	/// </summary>
+	/// <returns>The moved instruction, so that more operands can be added to it.</returns>
+	spirv_instruction move_to_back(size_t index);
+
+	/// <summary>
+	/// Write the instructions starting at the specified <paramref name="first"/> index to a SPIR-V module.
+	/// </summary>
+	/// <param name="output">The output stream to append the instructions to.</param>
+	void write(std::basic_string<char> &output, size_t first = 0) const
+	{
+		if (first >= instructions.size())
+			return;
+
+		output.append(reinterpret_cast<const char *>(words.data() + instructions[first].offset), (words.size() - instructions[first].offset) * sizeof(uint32_t));
+	}
+};
+
 /// <summary>
-/// A single instruction in a SPIR-V module
+/// A single instruction in a SPIR-V module, which is currently being added to the end of a basic block
 /// </summary>
 struct spirv_instruction
 {
-	spv::Op op;
-	spv::Id type;
+	spirv_basic_block *block;
+	uint32_t offset;
 	spv::Id result;
-	std::vector<spv::Id> operands;
-
-	explicit spirv_instruction(spv::Op op = spv::OpNop) : op(op), type(0), result(0) {}
-	spirv_instruction(spv::Op op, spv::Id result) : op(op), type(result), result(0) {}
-	spirv_instruction(spv::Op op, spv::Id type, spv::Id result) : op(op), type(type), result(result) {}
 
 	/// <summary>
 	/// Add a single operand to the instruction.
 	/// </summary>
 	spirv_instruction &add(spv::Id operand)
 	{
-		operands.push_back(operand);
+		// Operands can only be added while there is no other instruction following this one in the block
+		assert(block->instructions.back().offset == offset);
+		assert((block->words[offset] >> spv::WordCountShift) < 0xFFFF);
+
+		block->words.push_back(operand);
+		block->words[offset] += 1u << spv::WordCountShift;
 		return *this;
 	}
 
@@ -54,7 +171,8 @@ struct spirv_instruction
 	template <typename It>
 	spirv_instruction &add(It begin, It end)
 	{
-		operands.insert(operands.end(), begin, end);
+		for (; begin != end; ++begin)
+			add(*begin);
 		return *this;
 	}
 
@@ -63,7 +181,7 @@ struct spirv_instruction
 	/// </summary>
 	spirv_instruction &add_string(const char *string)
 	{
-		assert(std::strlen(string) <= (0xFFFF - (1 + operands.size())) * 4 - 1);
+		assert(std::strlen(string) <= (0xFFFF - (block->words.size() - offset)) * 4 - 1);
 		uint32_t word;
 		do {
 			word = 0;
@@ -75,40 +193,11 @@ struct spirv_instruction
 	}
 
 	/// <summary>
-	/// Write this instruction to a SPIR-V module.
+	/// Get a reference to an existing operand of the instruction.
 	/// </summary>
-	/// <param name="output">The output stream to append this instruction to.</param>
-	void write(std::basic_string<char> &output) const
-	{
-		// See https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html
-		// 0             | Opcode: The 16 high-order bits are the WordCount of the instruction. The 16 low-order bits are the opcode enumerant.
-		// 1             | Optional instruction type <id>
-		// .             | Optional instruction Result <id>
-		// .             | Operand 1 (if needed)
-		// .             | Operand 2 (if needed)
-		// ...           | ...
-		// WordCount - 1 | Operand N (N is determined by WordCount minus the 1 to 3 words used for the opcode, instruction type <id>, and instruction Result <id>).
-
-		const uint32_t word_count = 1 + (type != 0) + (result != 0) + static_cast<uint32_t>(operands.size());
-		assert(word_count <= 0xFFFF);
-		write_word(output, (word_count << spv::WordCountShift) | op);
-
-		// Optional instruction type ID
-		if (type != 0)
-			write_word(output, type);
-
-		// Optional instruction result ID
-		if (result != 0)
-			write_word(output, result);
-
-		// Write out the operands
-		for (const uint32_t operand : operands)
-			write_word(output, operand);
-	}
-
-	static void write_word(std::basic_string<char> &output, uint32_t word)
+	spv::Id &operand(size_t index)
 	{
-		output.insert(output.end(), reinterpret_cast<const char *>(&word), reinterpret_cast<const char *>(&word + 1));
+		return block->words[offset + block->instructions.back().first_operand + index];
 	}
 
 	operator uint32_t() const
@@ -119,33 +208,64 @@ struct spirv_instruction
 	}
 };
 
-/// <summary>
-/// A list of instructions forming a basic block in the SPIR-V module
-/// </summary>
-struct spirv_basic_block
+inline spirv_instruction spirv_basic_block::add_instruction(spv::Op op, spv::Id type, spv::Id result)
 {
-	std::vector<spirv_instruction> instructions;
+	const uint32_t offset = static_cast<uint32_t>(words.size());
+	const uint32_t first_operand = 1 + (type != 0) + (result != 0);
+
+	// See https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html
+	// 0             | Opcode: The 16 high-order bits are the WordCount of the instruction. The 16 low-order bits are the opcode enumerant.
+	// 1             | Optional instruction type <id>
+	// .             | Optional instruction Result <id>
+	// .             | Operand 1 (if needed)
+	// .             | Operand 2 (if needed)
+	// ...           | ...
+	// WordCount - 1 | Operand N (N is determined by WordCount minus the 1 to 3 words used for the opcode, instruction type <id>, and instruction Result <id>).
+	words.push_back((first_operand << spv::WordCountShift) | op);
+
+	// Optional instruction type ID
+	if (type != 0)
+		words.push_back(type);
+
+	// Optional instruction result ID
+	if (result != 0)
+		words.push_back(result);
+
+	instructions.push_back({ offset, first_operand });
+
+	return { this, offset, result };
+}
 
-	/// <summary>
-	/// Append another basic block the end of this one.
-	/// </summary>
-	void append(const spirv_basic_block &block)
-	{
-		instructions.insert(instructions.end(), block.instructions.begin(), block.instructions.end());
-	}
-};
+inline spirv_instruction spirv_basic_block::move_to_back(size_t index)
+{
+	assert(index < instructions.size());
+
+	const instruction_offset moved = instructions[index];
+	const uint32_t moved_word_count = words[moved.offset] >> spv::WordCountShift;
+
+	std::rotate(words.begin() + moved.offset, words.begin() + moved.offset + moved_word_count, words.end());
+
+	// Instructions following the moved one are now located that many words earlier
+	for (size_t i = index + 1; i < instructions.size(); ++i)
+		instructions[i - 1] = { instructions[i].offset - moved_word_count, instructions[i].first_operand };
+	instructions.back() = { static_cast<uint32_t>(words.size()) - moved_word_count, moved.first_operand };
+
+	const spirv_instruction_view inst = back();
+	return { this, instructions.back().offset, inst.result() };
+}
 
 class codegen_spirv final : public codegen
 {
 	static_assert(sizeof(id) == sizeof(spv::Id), "unexpected SPIR-V id type size");
 
 public:
-	codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y) :
+	codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y, int optimization_level) :
 		_debug_info(debug_info),
 		_vulkan_semantics(vulkan_semantics),
 		_uniforms_to_spec_constants(uniforms_to_spec_constants),
 		_enable_16bit_types(enable_16bit_types),
-		_flip_vert_y(flip_vert_y)
+		_flip_vert_y(flip_vert_y),
+		_optimization_level(optimization_level)
 	{
 		_glsl_ext = make_id();
 	}
@@ -162,16 +282,55 @@ private:
 		{
 			return lhs.type == rhs.type && lhs.is_ptr == rhs.is_ptr && lhs.array_stride == rhs.array_stride && lhs.storage == rhs.storage;
 		}
+
+		struct hash
+		{
+			size_t operator()(const type_lookup &key) const
+			{
+				size_t seed = hash_type(key.type);
+				hash_combine(seed, (static_cast<size_t>(key.array_stride) << 1) | key.is_ptr);
+				hash_combine(seed, (static_cast<size_t>(key.storage.first) << 16) | key.storage.second);
+				return seed;
+			}
+		};
 	};
-	struct function_blocks
+	struct constant_lookup
+	{
+		reshadefx::type type;
+		reshadefx::constant data;
+
+		friend bool operator==(const constant_lookup &lhs, const constant_lookup &rhs)
+		{
+			// Only compare the raw scalar data of the constant and its array elements, strings are not relevant to code generation
+			if (!(lhs.type == rhs.type && std::memcmp(&lhs.data.as_uint[0], &rhs.data.as_uint[0], sizeof(uint32_t) * 16) == 0 && lhs.data.array_data.size() == rhs.data.array_data.size()))
+				return false;
+			for (size_t i = 0; i < lhs.data.array_data.size(); ++i)
+				if (std::memcmp(&lhs.data.array_data[i].as_uint[0], &rhs.data.array_data[i].as_uint[0], sizeof(uint32_t) * 16) != 0)
+					return false;
+			return true;
+		}
+
+		struct hash
+		{
+			size_t operator()(const constant_lookup &key) const
+			{
+				size_t seed = hash_type(key.type);
+				for (const uint32_t value : key.data.as_uint)
+					hash_combine(seed, value);
+				hash_combine(seed, key.data.array_data.size());
+				for (const reshadefx::constant &elem : key.data.array_data)
+					for (const uint32_t value : elem.as_uint)
+						hash_combine(seed, value);
+				return seed;
+			}
+		};
+	};
+	struct function_type_lookup
 	{
-		spirv_basic_block declaration;
-		spirv_basic_block variables;
-		spirv_basic_block definition;
 		reshadefx::type return_type;
 		std::vector<reshadefx::type> param_types;
 
-		friend bool operator==(const function_blocks &lhs, const function_blocks &rhs)
+		friend bool operator==(const function_type_lookup &lhs, const function_type_lookup &rhs)
 		{
 			if (lhs.param_types.size() != rhs.param_types.size())
 				return false;
@@ -180,6 +339,25 @@ private:
 					return false;
 			return lhs.return_type == rhs.return_type;
 		}
+
+		struct hash
+		{
+			size_t operator()(const function_type_lookup &key) const
+			{
+				size_t seed = hash_type(key.return_type);
+				for (const reshadefx::type &param_type : key.param_types)
+					hash_combine(seed, hash_type(param_type));
+				return seed;
+			}
+		};
+	};
+	struct function_blocks
+	{
+		spirv_basic_block declaration;
+		spirv_basic_block variables;
+		spirv_basic_block definition;
+		reshadefx::type return_type;
+		std::vector<reshadefx::type> param_types;
 	};
 
 	bool _debug_info = false;
@@ -187,6 +365,7 @@ private:
 	bool _uniforms_to_spec_constants = false;
 	bool _enable_16bit_types = false;
 	bool _flip_vert_y = false;
+	int _optimization_level = -1;
 
 	spirv_basic_block _entries;
 	spirv_basic_block _execution_modes;
@@ -206,9 +385,9 @@ private:
 	std::vector<spv::Id> _global_ubo_types;
 	function_blocks *_current_function_blocks = nullptr;
 
-	std::vector<std::pair<type_lookup, spv::Id>> _type_lookup;
-	std::vector<std::tuple<type, constant, spv::Id>> _constant_lookup;
-	std::vector<std::pair<function_blocks, spv::Id>> _function_type_lookup;
+	std::unordered_map<type_lookup, spv::Id, type_lookup::hash> _type_lookup;
+	std::unordered_map<constant_lookup, spv::Id, constant_lookup::hash> _constant_lookup;
+	std::unordered_map<function_type_lookup, spv::Id, function_type_lookup::hash> _function_type_lookup;
 	std::unordered_map<std::string, spv::Id> _string_lookup;
 	std::unordered_map<spv::Id, std::pair<spv::StorageClass, spv::ImageFormat>> _storage_lookup;
 	std::unordered_map<std::string, uint32_t> _semantic_to_location;
@@ -278,79 +457,79 @@ private:
 			.add(loc.line)
 			.add(loc.column);
 	}
-	spirv_instruction &add_instruction(spv::Op op, spv::Id type = 0)
+	spirv_instruction add_instruction(spv::Op op, spv::Id type = 0)
 	{
 		assert(is_in_function() && is_in_block());
 
 		return add_instruction(op, type, *_current_block_data);
 	}
-	spirv_instruction &add_instruction(spv::Op op, spv::Id type, spirv_basic_block &block)
+	spirv_instruction add_instruction(spv::Op op, spv::Id type, spirv_basic_block &block)
 	{
-		spirv_instruction &instruction = add_instruction_without_result(op, block);
-		instruction.type = type;
-		instruction.result = make_id();
-		return instruction;
+		return block.add_instruction(op, type, make_id());
 	}
-	spirv_instruction &add_instruction_without_result(spv::Op op)
+	spirv_instruction add_instruction_without_result(spv::Op op)
 	{
 		assert(is_in_function() && is_in_block());
 
 		return add_instruction_without_result(op, *_current_block_data);
 	}
-	spirv_instruction &add_instruction_without_result(spv::Op op, spirv_basic_block &block)
+	spirv_instruction add_instruction_without_result(spv::Op op, spirv_basic_block &block)
 	{
-		return block.instructions.emplace_back(op);
+		return block.add_instruction(op);
 	}
 
 	void finalize_header_section(std::basic_string<char> &spirv) const
 	{
+		spirv_basic_block section;
+
 		// Write SPIRV header info
-		spirv_instruction::write_word(spirv, spv::MagicNumber);
-		spirv_instruction::write_word(spirv, 0x10300); // Force SPIR-V 1.3
-		spirv_instruction::write_word(spirv, 0u); // Generator magic number, see https://www.khronos.org/registry/spir-v/api/spir-v.xml
-		spirv_instruction::write_word(spirv, _next_id); // Maximum ID
-		spirv_instruction::write_word(spirv, 0u); // Reserved for instruction schema
+		section.words = {
+			spv::MagicNumber,
+			0x10300, // Force SPIR-V 1.3
+			0u, // Generator magic number, see https://www.khronos.org/registry/spir-v/api/spir-v.xml
+			_next_id, // Maximum ID
+			0u // Reserved for instruction schema
+		};
 
 		// All capabilities
-		spirv_instruction(spv::OpCapability)
-			.add(spv::CapabilityShader) // Implicitly declares the Matrix capability too
-			.write(spirv);
+		section.add_instruction(spv::OpCapability)
+			.add(spv::CapabilityShader); // Implicitly declares the Matrix capability too
 
 		for (const spv::Capability capability : _capabilities)
-			spirv_instruction(spv::OpCapability)
-				.add(capability)
-				.write(spirv);
+			section.add_instruction(spv::OpCapability)
+				.add(capability);
 
 		// Optional extension instructions
-		spirv_instruction(spv::OpExtInstImport, _glsl_ext)
-			.add_string("GLSL.std.450") // Import GLSL extension
-			.write(spirv);
+		section.add_instruction(spv::OpExtInstImport, 0, _glsl_ext)
+			.add_string("GLSL.std.450"); // Import GLSL extension
 
 		// Single required memory model instruction
-		spirv_instruction(spv::OpMemoryModel)
+		section.add_instruction(spv::OpMemoryModel)
 			.add(spv::AddressingModelLogical)
-			.add(spv::MemoryModelGLSL450)
-			.write(spirv);
+			.add(spv::MemoryModelGLSL450);
+
+		spirv.append(reinterpret_cast<const char *>(section.words.data()), section.words.size() * sizeof(uint32_t));
 	}
 	void finalize_debug_info_section(std::basic_string<char> &spirv) const
 	{
-		spirv_instruction(spv::OpSource)
+		spirv_basic_block section;
+
+		section.add_instruction(spv::OpSource)
 			.add(spv::SourceLanguageUnknown) // ReShade FX is not a reserved token at the moment
-			.add(0) // Language version, TODO: Maybe fill in ReShade version here?
-			.write(spirv);
+			.add(0); // Language version, TODO: Maybe fill in ReShade version here?
+
+		section.write(spirv);
 
 		if (_debug_info)
 		{
 			// All debug instructions
-			for (const spirv_instruction &inst : _debug_a.instructions)
-				inst.write(spirv);
+			_debug_a.write(spirv);
 		}
 	}
 	void finalize_type_and_constants_section(std::basic_string<char> &spirv) const
 	{
 		// All type declarations
-		for (const spirv_instruction &inst : _types_and_constants.instructions)
-			inst.write(spirv);
+		_types_and_constants.write(spirv);
 
 		// Initialize the UBO type now that all member types are known
 		if (_global_ubo_type == 0 || _global_ubo_variable == 0)
@@ -358,17 +537,18 @@ private:
 
 		const id global_ubo_type_ptr = _global_ubo_type + 1;
 
-		spirv_instruction(spv::OpTypeStruct, _global_ubo_type)
-			.add(_global_ubo_types.begin(), _global_ubo_types.end())
-			.write(spirv);
-		spirv_instruction(spv::OpTypePointer, global_ubo_type_ptr)
-			.add(spv::StorageClassUniform)
-			.add(_global_ubo_type)
-			.write(spirv);
+		spirv_basic_block section;
 
-		spirv_instruction(spv::OpVariable, global_ubo_type_ptr, _global_ubo_variable)
+		section.add_instruction(spv::OpTypeStruct, 0, _global_ubo_type)
+			.add(_global_ubo_types.begin(), _global_ubo_types.end());
+		section.add_instruction(spv::OpTypePointer, 0, global_ubo_type_ptr)
 			.add(spv::StorageClassUniform)
-			.write(spirv);
+			.add(_global_ubo_type);
+
+		section.add_instruction(spv::OpVariable, global_ubo_type_ptr, _global_ubo_variable)
+			.add(spv::StorageClassUniform);
+
+		section.write(spirv);
 	}
 
 	std::string finalize_code() const override
@@ -384,38 +564,74 @@ private:
 
 		spirv.clear();
 
+		// Reserve enough space for the entire module up front (which is slightly more than needed, since some instructions are removed below), to avoid reallocating while appending to it
+		size_t total_word_count = 64 + _entries.words.size() + _execution_modes.words.size() + _debug_a.words.size() + _debug_b.words.size() + _annotations.words.size() + _types_and_constants.words.size() + _global_ubo_types.size() + _variables.words.size();
+		for (const function_blocks &function : _functions_blocks)
+			total_word_count += function.declaration.words.size() + function.variables.words.size() + function.definition.words.size();
+		spirv.reserve(total_word_count * sizeof(uint32_t));
+
 		finalize_header_section(spirv);
 
-		// Build list of IDs to remove
-		std::vector<spv::Id> variables_to_remove;
-		std::vector<spv::Id> functions_to_remove;
+		// Build list of IDs to remove, so that the module only contains what is actually referenced by this entry point
+		std::unordered_set<spv::Id> ids_to_remove;
+
+		// Remove all sampler and storage variables not referenced by this entry point
+		for (const sampler &info : _module.samplers)
+			if (std::find(entry_point->referenced_samplers.begin(), entry_point->referenced_samplers.end(), info.id) == entry_point->referenced_samplers.end())
+				ids_to_remove.insert(info.id);
+		for (const storage &info : _module.storages)
+			if (std::find(entry_point->referenced_storages.begin(), entry_point->referenced_storages.end(), info.id) == entry_point->referenced_storages.end())
+				ids_to_remove.insert(info.id);
+
+		// Remove all function definitions not referenced by this entry point (which includes the other entry points), together with all IDs defined within them
+		std::vector<bool> functions_to_remove(_functions_blocks.size());
+		for (size_t function_index = 0; function_index < _functions_blocks.size(); ++function_index)
+		{
+			const function_blocks &function = _functions_blocks[function_index];
+			if (function.definition.empty())
+				continue;
+
+			assert(function.declaration[function.declaration[0].op() != spv::OpFunction ? 1 : 0].op() == spv::OpFunction);
+			const spv::Id definition = function.declaration[function.declaration[0].op() != spv::OpFunction ? 1 : 0].result();
+
+			if (definition == entry_point->id ||
+				std::find(entry_point->referenced_functions.begin(), entry_point->referenced_functions.end(), definition) != entry_point->referenced_functions.end())
+				continue;
+
+			functions_to_remove[function_index] = true;
+
+			for (const spirv_basic_block *block : { &function.declaration, &function.variables, &function.definition })
+				for (size_t i = 0; i < block->size(); ++i)
+					if (const spv::Id result = (*block)[i].result(); result != 0)
+						ids_to_remove.insert(result);
+		}
 
 		// The entry point and execution mode declaration
-		for (const spirv_instruction &inst : _entries.instructions)
+		for (size_t i = 0; i < _entries.size(); ++i)
 		{
-			assert(inst.op == spv::OpEntryPoint);
+			const spirv_instruction_view inst = _entries[i];
+			assert(inst.op() == spv::OpEntryPoint);
 
 			// Only add the matching entry point
-			if (inst.operands[1] == entry_point->id)
+			if (inst.operands()[1] == entry_point->id)
 			{
 				inst.write(spirv);
 			}
 			else
 			{
-				functions_to_remove.push_back(inst.operands[1]);
-
-				// Add interface variables to list of variables to remove
-				for (uint32_t k = 2 + static_cast<uint32_t>((std::strlen(reinterpret_cast<const char *>(&inst.operands[2])) + 4) / 4); k < inst.operands.size(); ++k)
-					variables_to_remove.push_back(inst.operands[k]);
+				// Add interface variables to list of IDs to remove
+				for (uint32_t k = 2 + static_cast<uint32_t>((std::strlen(reinterpret_cast<const char *>(&inst.operands()[2])) + 4) / 4); k < inst.operand_count(); ++k)
+					ids_to_remove.insert(inst.operands()[k]);
 			}
 		}
 
-		for (const spirv_instruction &inst : _execution_modes.instructions)
+		for (size_t i = 0; i < _execution_modes.size(); ++i)
 		{
-			assert(inst.op == spv::OpExecutionMode);
+			const spirv_instruction_view inst = _execution_modes[i];
+			assert(inst.op() == spv::OpExecutionMode);
 
 			// Only add execution mode for the matching entry point
-			if (inst.operands[0] == entry_point->id)
+			if (inst.operands()[0] == entry_point->id)
 			{
 				inst.write(spirv);
 			}
@@ -423,35 +639,46 @@ private:
 
 		finalize_debug_info_section(spirv);
 
-		for (const spirv_instruction &inst : _debug_b.instructions)
+		for (size_t i = 0; i < _debug_b.size(); ++i)
 		{
-			// Remove all names of interface variables and functions for non-matching entry points
-			if (std::find(variables_to_remove.begin(), variables_to_remove.end(), inst.operands[0]) != variables_to_remove.end() ||
-				std::find(functions_to_remove.begin(), functions_to_remove.end(), inst.operands[0]) != functions_to_remove.end())
+			const spirv_instruction_view inst = _debug_b[i];
+
+			// Remove all names of removed variables and functions
+			if (ids_to_remove.find(inst.operands()[0]) != ids_to_remove.end())
 				continue;
 
 			inst.write(spirv);
 		}
 
 		// All annotation instructions
-		for (spirv_instruction inst : _annotations.instructions)
+		for (size_t i = 0; i < _annotations.size(); ++i)
 		{
-			if (inst.op == spv::OpDecorate)
+			const spirv_instruction_view inst = _annotations[i];
+
+			if (inst.op() == spv::OpDecorate)
 			{
-				// Remove all decorations targeting any of the interface variables for non-matching entry points
-				if (std::find(variables_to_remove.begin(), variables_to_remove.end(), inst.operands[0]) != variables_to_remove.end())
+				// Remove all decorations targeting any of the removed variables or instructions in removed functions
+				if (ids_to_remove.find(inst.operands()[0]) != ids_to_remove.end())
 					continue;
 
 				// Replace bindings
-				if (inst.operands[1] == spv::DecorationBinding)
+				if (inst.operands()[1] == spv::DecorationBinding)
 				{
-					if (const auto referenced_sampler_it = std::find(entry_point->referenced_samplers.begin(), entry_point->referenced_samplers.end(), inst.operands[0]);
+					uint32_t binding = inst.operands()[2];
+
+					if (const auto referenced_sampler_it = std::find(entry_point->referenced_samplers.begin(), entry_point->referenced_samplers.end(), inst.operands()[0]);
 						referenced_sampler_it != entry_point->referenced_samplers.end())
-						inst.operands[2] = static_cast<uint32_t>(referenced_sampler_it - entry_point->referenced_samplers.begin());
+						binding = static_cast<uint32_t>(referenced_sampler_it - entry_point->referenced_samplers.begin());
 					else
-					if (const auto referenced_storage_it = std::find(entry_point->referenced_storages.begin(), entry_point->referenced_storages.end(), inst.operands[0]);
+					if (const auto referenced_storage_it = std::find(entry_point->referenced_storages.begin(), entry_point->referenced_storages.end(), inst.operands()[0]);
 						referenced_storage_it != entry_point->referenced_storages.end())
-						inst.operands[2] = static_cast<uint32_t>(referenced_storage_it - entry_point->referenced_storages.begin());
+						binding = static_cast<uint32_t>(referenced_storage_it - entry_point->referenced_storages.begin());
+
+					// Write instruction and then overwrite the binding operand in the output, since the instruction itself is shared by all entry points
+					const size_t binding_offset = spirv.size() + (inst.first_operand + 2) * sizeof(uint32_t);
+					inst.write(spirv);
+					std::memcpy(spirv.data() + binding_offset, &binding, sizeof(binding));
+					continue;
 				}
 			}
 
@@ -460,40 +687,37 @@ private:
 
 		finalize_type_and_constants_section(spirv);
 
-		for (const spirv_instruction &inst : _variables.instructions)
+		for (size_t i = 0; i < _variables.size(); ++i)
 		{
-			// Remove all declarations of the interface variables for non-matching entry points
-			if (inst.op == spv::OpVariable && std::find(variables_to_remove.begin(), variables_to_remove.end(), inst.result) != variables_to_remove.end())
+			const spirv_instruction_view inst = _variables[i];
+
+			// Remove all declarations of interface variables for non-matching entry points and of unreferenced samplers and storages
+			if (inst.op() == spv::OpVariable && ids_to_remove.find(inst.result()) != ids_to_remove.end())
 				continue;
 
 			inst.write(spirv);
 		}
 
 		// All referenced function definitions
-		for (const function_blocks &function : _functions_blocks)
+		for (size_t function_index = 0; function_index < _functions_blocks.size(); ++function_index)
 		{
-			if (function.definition.instructions.empty())
+			const function_blocks &function = _functions_blocks[function_index];
+			if (function.definition.empty() || functions_to_remove[function_index])
 				continue;
 
-			assert(function.declaration.instructions[function.declaration.instructions[0].op != spv::OpFunction ? 1 : 0].op == spv::OpFunction);
-			const spv::Id definition = function.declaration.instructions[function.declaration.instructions[0].op != spv::OpFunction ? 1 : 0].result;
-
-			if (std::find(functions_to_remove.begin(), functions_to_remove.end(), definition) != functions_to_remove.end())
-				continue;
-
-			for (const spirv_instruction &inst : function.declaration.instructions)
-				inst.write(spirv);
+			function.declaration.write(spirv);
 
 			// Grab first label and move it in front of variable declarations
-			function.definition.instructions.front().write(spirv);
-			assert(function.definition.instructions.front().op == spv::OpLabel);
+			function.definition[0].write(spirv);
+			assert(function.definition[0].op() == spv::OpLabel);
 
-			for (const spirv_instruction &inst : function.variables.instructions)
-				inst.write(spirv);
-			for (auto inst_it = function.definition.instructions.begin() + 1; inst_it != function.definition.instructions.end(); ++inst_it)
-				inst_it->write(spirv);
+			function.variables.write(spirv);
+			function.definition.write(spirv, 1);
 		}
 
+		if (_optimization_level >= 0)
+			optimize_spirv(spirv, _optimization_level);
+
 		return true;
 	}
 
@@ -519,8 +743,7 @@ private:
 
 		const type_lookup lookup { info, is_ptr, array_stride, { storage, format } };
 
-		if (const auto lookup_it = std::find_if(_type_lookup.begin(), _type_lookup.end(),
-				[&lookup](const std::pair<type_lookup, spv::Id> &lookup_entry) { return lookup_entry.first == lookup; });
+		if (const auto lookup_it = _type_lookup.find(lookup);
 			lookup_it != _type_lookup.end())
 			return lookup_it->second;
 
@@ -688,14 +911,15 @@ private:
 			}
 		}
 
-		_type_lookup.push_back({ lookup, type_id });
+		_type_lookup.emplace(lookup, type_id);
 
 		return type_id;
 	}
 	spv::Id convert_type(const function_blocks &info)
 	{
-		if (const auto lookup_it = std::find_if(_function_type_lookup.begin(), _function_type_lookup.end(),
-				[&lookup = info](const std::pair<function_blocks, spv::Id> &lookup_entry) { return lookup_entry.first == lookup; });
+		function_type_lookup lookup { info.return_type, info.param_types };
+
+		if (const auto lookup_it = _function_type_lookup.find(lookup);
 			lookup_it != _function_type_lookup.end())
 			return lookup_it->second;
 
@@ -707,11 +931,11 @@ private:
 		for (const type &param_type : info.param_types)
 			param_type_ids.push_back(convert_type(param_type, true));
 
-		spirv_instruction &inst = add_instruction(spv::OpTypeFunction, 0, _types_and_constants)
+		spirv_instruction inst = add_instruction(spv::OpTypeFunction, 0, _types_and_constants)
 			.add(return_type_id)
 			.add(param_type_ids.begin(), param_type_ids.end());
 
-		_function_type_lookup.push_back({ info, inst });
+		_function_type_lookup.emplace(std::move(lookup), inst);
 
 		return inst;
 	}
@@ -739,8 +963,7 @@ private:
 			lookup.type.struct_definition = static_cast<uint32_t>(elem_info.base);
 		}
 
-		if (const auto lookup_it = std::find_if(_type_lookup.begin(), _type_lookup.end(),
-				[&lookup](const std::pair<type_lookup, spv::Id> &lookup_entry) { return lookup_entry.first == lookup; });
+		if (const auto lookup_it = _type_lookup.find(lookup);
 			lookup_it != _type_lookup.end())
 			return lookup_it->second;
 
@@ -755,7 +978,7 @@ private:
 				.add(info.is_storage() ? 2 : 1) // Used with a sampler or as storage
 				.add(format);
 
-		_type_lookup.push_back({ lookup, type_id });
+		_type_lookup.emplace(lookup, type_id);
 
 		return type_id;
 	}
@@ -1009,11 +1232,11 @@ private:
 
 			add_name(res, info.unique_name.c_str());
 
-			const auto add_spec_constant = [this](const spirv_instruction &inst, const uniform &info, const constant &initializer_value, size_t initializer_offset) {
-				assert(inst.op == spv::OpSpecConstant || inst.op == spv::OpSpecConstantTrue || inst.op == spv::OpSpecConstantFalse);
+			const auto add_spec_constant = [this](const spirv_instruction_view &inst, const uniform &info, const constant &initializer_value, size_t initializer_offset) {
+				assert(inst.op() == spv::OpSpecConstant || inst.op() == spv::OpSpecConstantTrue || inst.op() == spv::OpSpecConstantFalse);
 
 				const uint32_t spec_id = static_cast<uint32_t>(_module.spec_constants.size());
-				add_decoration(inst, spv::DecorationSpecId, { spec_id });
+				add_decoration(inst.result(), spv::DecorationSpecId, { spec_id });
 
 				uniform scalar_info = info;
 				scalar_info.type.rows = 1;
@@ -1025,9 +1248,17 @@ private:
 
 				_module.spec_constants.push_back(std::move(scalar_info));
 			};
+			const auto find_constant = [this](spv::Id id) {
+				// Constants referenced by a composite were usually just declared, so search backwards
+				for (size_t i = _types_and_constants.size(); i-- > 0;)
+					if (const spirv_instruction_view inst = _types_and_constants[i]; inst.result() == id)
+						return inst;
+				assert(false);
+				return _types_and_constants.back();
+			};
 
-			const spirv_instruction &base_inst = _types_and_constants.instructions.back();
-			assert(base_inst == res);
+			const spirv_instruction_view base_inst = _types_and_constants.back();
+			assert(base_inst.result() == res);
 
 			// External specialization constants need to be scalars
 			if (info.type.is_scalar())
@@ -1036,38 +1267,35 @@ private:
 			}
 			else
 			{
-				assert(base_inst.op == spv::OpSpecConstantComposite);
+				assert(base_inst.op() == spv::OpSpecConstantComposite);
 
 				// Add each individual scalar component of the constant as a separate external specialization constant
-				for (size_t i = 0; i < (info.type.is_array() ? base_inst.operands.size() : 1); ++i)
+				for (size_t i = 0; i < (info.type.is_array() ? base_inst.operand_count() : 1); ++i)
 				{
 					constant initializer_value = info.initializer_value;
-					spirv_instruction elem_inst = base_inst;
+					spirv_instruction_view elem_inst = base_inst;
 
 					if (info.type.is_array())
 					{
-						elem_inst = *std::find_if(_types_and_constants.instructions.rbegin(), _types_and_constants.instructions.rend(),
-							[operand_id = base_inst.operands[i]](const spirv_instruction &inst) { return inst == operand_id; });
+						elem_inst = find_constant(base_inst.operands()[i]);
 
-						assert(initializer_value.array_data.size() == base_inst.operands.size());
+						assert(initializer_value.array_data.size() == base_inst.operand_count());
 						initializer_value = initializer_value.array_data[i];
 					}
 
-					for (size_t row = 0; row < elem_inst.operands.size(); ++row)
+					for (size_t row = 0; row < elem_inst.operand_count(); ++row)
 					{
-						const spirv_instruction &row_inst = *std::find_if(_types_and_constants.instructions.rbegin(), _types_and_constants.instructions.rend(),
-							[operand_id = elem_inst.operands[row]](const spirv_instruction &inst) { return inst == operand_id; });
+						const spirv_instruction_view row_inst = find_constant(elem_inst.operands()[row]);
 
-						if (row_inst.op != spv::OpSpecConstantComposite)
+						if (row_inst.op() != spv::OpSpecConstantComposite)
 						{
 							add_spec_constant(row_inst, info, initializer_value, row);
 							continue;
 						}
 
-						for (size_t col = 0; col < row_inst.operands.size(); ++col)
+						for (size_t col = 0; col < row_inst.operand_count(); ++col)
 						{
-							const spirv_instruction &col_inst = *std::find_if(_types_and_constants.instructions.rbegin(), _types_and_constants.instructions.rend(),
-								[operand_id = row_inst.operands[col]](const spirv_instruction &inst) { return inst == operand_id; });
+							const spirv_instruction_view col_inst = find_constant(row_inst.operands()[col]);
 
 							add_spec_constant(col_inst, info, initializer_value, row * info.type.cols + col);
 						}
@@ -1166,7 +1394,7 @@ private:
 		add_location(loc, block);
 
 		// https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html#OpVariable
-		spirv_instruction &inst = add_instruction(spv::OpVariable, convert_type(type, true, storage, format), block);
+		spirv_instruction inst = add_instruction(spv::OpVariable, convert_type(type, true, storage, format), block);
 		inst.add(storage);
 
 		const id res = inst.result;
@@ -1590,7 +1818,9 @@ private:
 				it != _storage_lookup.end())
 				storage = it->second;
 
-			spirv_instruction *access_chain = nullptr;
+			// The result type of an access chain is only known after all indices were added, so collect them and only emit the instruction at the end
+			spv::Id access_chain = 0;
+			std::vector<spv::Id> access_chain_operands;
 
 			// Check if this is a uniform variable (see 'define_uniform' function above) and dereference it
 			if (result & 0xF0000000)
@@ -1603,9 +1833,9 @@ private:
 				if (is_uniform_bool)
 					base_type.base = type::t_uint;
 
-				access_chain = &add_instruction(spv::OpAccessChain)
-					.add(_global_ubo_variable)
-					.add(emit_constant(member_index));
+				access_chain = make_id();
+				access_chain_operands.push_back(_global_ubo_variable);
+				access_chain_operands.push_back(emit_constant(member_index));
 			}
 
 			// Any indexing expressions can be resolved during load with an 'OpAccessChain' already
@@ -1614,12 +1844,12 @@ private:
 				exp.chain[0].op == expression::operation::op_dynamic_index ||
 				exp.chain[0].op == expression::operation::op_constant_index))
 			{
-				// Ensure that 'access_chain' cannot get invalidated by calls to 'emit_constant' or 'convert_type'
-				assert(_current_block_data != &_types_and_constants);
-
 				// Use access chain from uniform if possible, otherwise create new one
-				if (access_chain == nullptr) access_chain =
-					&add_instruction(spv::OpAccessChain).add(result); // Base
+				if (access_chain == 0)
+				{
+					access_chain = make_id();
+					access_chain_operands.push_back(result); // Base
+				}
 
 				// Ignore first index into 1xN matrices, since they were translated to a vector type in SPIR-V
 				if (exp.chain[0].from.rows == 1 && exp.chain[0].from.cols > 1)
@@ -1629,18 +1859,18 @@ private:
 					exp.chain[i].op == expression::operation::op_member ||
 					exp.chain[i].op == expression::operation::op_dynamic_index ||
 					exp.chain[i].op == expression::operation::op_constant_index); ++i)
-					access_chain->add(exp.chain[i].op == expression::operation::op_dynamic_index ?
+					access_chain_operands.push_back(exp.chain[i].op == expression::operation::op_dynamic_index ?
 						exp.chain[i].index :
 						emit_constant(exp.chain[i].index)); // Indexes
 
 				base_type = exp.chain[i - 1].to;
-				access_chain->type = convert_type(base_type, true, storage.first, storage.second); // Last type is the result
-				result = access_chain->result;
+				result = _current_block_data->add_instruction(spv::OpAccessChain, convert_type(base_type, true, storage.first, storage.second), access_chain) // Last type is the result
+					.add(access_chain_operands.begin(), access_chain_operands.end());
 			}
-			else if (access_chain != nullptr)
+			else if (access_chain != 0)
 			{
-				access_chain->type = convert_type(base_type, true, storage.first, storage.second, base_type.is_array() ? 16u : 0u);
-				result = access_chain->result;
+				result = _current_block_data->add_instruction(spv::OpAccessChain, convert_type(base_type, true, storage.first, storage.second, base_type.is_array() ? 16u : 0u), access_chain)
+					.add(access_chain_operands.begin(), access_chain_operands.end());
 			}
 
 			result =
@@ -1692,7 +1922,7 @@ private:
 						scalar_type.rows = 1;
 						scalar_type.cols = 1;
 
-						spirv_instruction &inst = add_instruction(spv::OpCompositeExtract, convert_type(scalar_type));
+						spirv_instruction inst = add_instruction(spv::OpCompositeExtract, convert_type(scalar_type));
 						inst.add(result);
 						inst.add(c);
 
@@ -1790,7 +2020,7 @@ private:
 				assert(op.to.is_vector());
 				if (op.from.is_vector())
 				{
-					spirv_instruction &inst = add_instruction(spv::OpVectorShuffle, convert_type(op.to));
+					spirv_instruction inst = add_instruction(spv::OpVectorShuffle, convert_type(op.to));
 					inst.add(result); // Vector 1
 					inst.add(result); // Vector 2
 					for (int c = 0; c < 4 && op.swizzle[c] >= 0; ++c)
@@ -1799,7 +2029,7 @@ private:
 				}
 				else
 				{
-					spirv_instruction &inst = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
+					spirv_instruction inst = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
 					for (unsigned int c = 0; c < op.to.rows; ++c)
 						inst.add(result);
 					result = inst;
@@ -1808,7 +2038,7 @@ private:
 			case expression::operation::op_matrix_swizzle:
 				if (op.swizzle[1] < 0)
 				{
-					spirv_instruction &inst = add_instruction(spv::OpCompositeExtract, convert_type(op.to));
+					spirv_instruction inst = add_instruction(spv::OpCompositeExtract, convert_type(op.to));
 					inst.add(result); // Composite
 					if (op.from.rows > 1)
 					{
@@ -1836,7 +2066,7 @@ private:
 						scalar_type.rows = 1;
 						scalar_type.cols = 1;
 
-						spirv_instruction &inst = add_instruction(spv::OpCompositeExtract, convert_type(scalar_type));
+						spirv_instruction inst = add_instruction(spv::OpCompositeExtract, convert_type(scalar_type));
 						inst.add(result);
 						if (op.from.rows > 1) // Matrix types with a single row are actually vectors, so they don't need the extra index
 							inst.add(row);
@@ -1845,7 +2075,7 @@ private:
 						components[c] = inst;
 					}
 
-					spirv_instruction &inst = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
+					spirv_instruction inst = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
 					for (int c = 0; c < 4 && op.swizzle[c] >= 0; ++c)
 						inst.add(components[c]);
 					result = inst;
@@ -1889,7 +2119,7 @@ private:
 						add_instruction(spv::OpLoad, convert_type(base_type))
 							.add(target); // Pointer
 
-					spirv_instruction &inst = add_instruction(spv::OpVectorShuffle, convert_type(base_type));
+					spirv_instruction inst = add_instruction(spv::OpVectorShuffle, convert_type(base_type));
 					inst.add(result); // Vector 1
 					inst.add(value); // Vector 2
 
@@ -1910,7 +2140,7 @@ private:
 						add_instruction(spv::OpLoad, convert_type(base_type))
 							.add(target); // Pointer
 
-					spirv_instruction &inst = add_instruction(spv::OpCompositeInsert, convert_type(base_type));
+					spirv_instruction inst = add_instruction(spv::OpCompositeInsert, convert_type(base_type));
 					inst.add(value); // Object
 					inst.add(result); // Composite
 					if (op.from.rows > 1)
@@ -1957,11 +2187,10 @@ private:
 			it != _storage_lookup.end())
 			storage = it->second;
 
-		// Ensure that 'access_chain' cannot get invalidated by calls to 'emit_constant' or 'convert_type'
-		assert(_current_block_data != &_types_and_constants);
-
-		spirv_instruction *access_chain =
-			&add_instruction(spv::OpAccessChain).add(exp.base); // Base
+		// The result type of an access chain is only known after all indices were added, so collect them and only emit the instruction at the end
+		const spv::Id access_chain = make_id();
+		std::vector<spv::Id> access_chain_operands;
+		access_chain_operands.push_back(exp.base); // Base
 
 		// Ignore first index into 1xN matrices, since they were translated to a vector type in SPIR-V
 		if (exp.chain[0].from.rows == 1 && exp.chain[0].from.cols > 1)
@@ -1971,12 +2200,12 @@ private:
 			exp.chain[i].op == expression::operation::op_member ||
 			exp.chain[i].op == expression::operation::op_dynamic_index ||
 			exp.chain[i].op == expression::operation::op_constant_index); ++i)
-			access_chain->add(exp.chain[i].op == expression::operation::op_dynamic_index ?
+			access_chain_operands.push_back(exp.chain[i].op == expression::operation::op_dynamic_index ?
 				exp.chain[i].index :
 				emit_constant(exp.chain[i].index)); // Indexes
 
-		access_chain->type = convert_type(exp.chain[i - 1].to, true, storage.first, storage.second); // Last type is the result
-		return access_chain->result;
+		return _current_block_data->add_instruction(spv::OpAccessChain, convert_type(exp.chain[i - 1].to, true, storage.first, storage.second), access_chain) // Last type is the result
+			.add(access_chain_operands.begin(), access_chain_operands.end());
 	}
 
 	using codegen::emit_constant;
@@ -1992,17 +2221,9 @@ private:
 	{
 		if (!spec_constant) // Specialization constants cannot reuse other constants
 		{
-			if (const auto it = std::find_if(_constant_lookup.begin(), _constant_lookup.end(),
-					[&data_type, &data](std::tuple<type, constant, spv::Id> &x) {
-						if (!(std::get<0>(x) == data_type && std::memcmp(&std::get<1>(x).as_uint[0], &data.as_uint[0], sizeof(uint32_t) * 16) == 0 && std::get<1>(x).array_data.size() == data.array_data.size()))
-							return false;
-						for (size_t i = 0; i < data.array_data.size(); ++i)
-							if (std::memcmp(&std::get<1>(x).array_data[i].as_uint[0], &data.array_data[i].as_uint[0], sizeof(uint32_t) * 16) != 0)
-								return false;
-						return true;
-					});
+			if (const auto it = _constant_lookup.find({ data_type, data });
 				it != _constant_lookup.end())
-				return std::get<2>(*it); // Reuse existing constant instead of duplicating the definition
+				return it->second; // Reuse existing constant instead of duplicating the definition
 		}
 
 		spv::Id result;
@@ -2058,7 +2279,7 @@ private:
 			}
 			else
 			{
-				spirv_instruction &inst = add_instruction(spec_constant ? spv::OpSpecConstantComposite : spv::OpConstantComposite, convert_type(data_type), _types_and_constants);
+				spirv_instruction inst = add_instruction(spec_constant ? spv::OpSpecConstantComposite : spv::OpConstantComposite, convert_type(data_type), _types_and_constants);
 				for (unsigned int i = 0; i < data_type.rows; ++i)
 					inst.add(rows[i]);
 				result = inst;
@@ -2082,7 +2303,7 @@ private:
 		if (spec_constant) // Keep track of all specialization constants
 			_spec_constants.insert(result);
 		else
-			_constant_lookup.push_back({ data_type, data, result });
+			_constant_lookup.emplace(constant_lookup { data_type, data }, result);
 
 		return result;
 	}
@@ -2109,7 +2330,7 @@ private:
 
 		add_location(loc, *_current_block_data);
 
-		spirv_instruction &inst = add_instruction(spv_op, convert_type(res_type));
+		spirv_instruction inst = add_instruction(spv_op, convert_type(res_type));
 		inst.add(val); // Operand
 
 		if (res_type.has(type::q_precise))
@@ -2221,7 +2442,7 @@ private:
 					.add(rhs)
 					.add(row);
 
-				spirv_instruction &inst = add_instruction(spv_op, convert_type(vector_type));
+				spirv_instruction inst = add_instruction(spv_op, convert_type(vector_type));
 				inst.add(lhs_elem); // Operand 1
 				inst.add(rhs_elem); // Operand 2
 
@@ -2233,13 +2454,13 @@ private:
 				ids.push_back(inst);
 			}
 
-			spirv_instruction &inst = add_instruction(spv::OpCompositeConstruct, convert_type(res_type));
+			spirv_instruction inst = add_instruction(spv::OpCompositeConstruct, convert_type(res_type));
 			inst.add(ids.begin(), ids.end());
 
 			return inst;
 		}
 
-		spirv_instruction &inst = add_instruction(spv_op, convert_type(res_type));
+		spirv_instruction inst = add_instruction(spv_op, convert_type(res_type));
 		inst.add(lhs); // Operand 1
 		inst.add(rhs); // Operand 2
 
@@ -2257,7 +2478,7 @@ private:
 
 		add_location(loc, *_current_block_data);
 
-		spirv_instruction &inst = add_instruction(spv::OpSelect, convert_type(res_type));
+		spirv_instruction inst = add_instruction(spv::OpSelect, convert_type(res_type));
 		inst.add(condition); // Condition
 		inst.add(true_value); // Object 1
 		inst.add(false_value); // Object 2
@@ -2273,7 +2494,7 @@ private:
 		add_location(loc, *_current_block_data);
 
 		// https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html#OpFunctionCall
-		spirv_instruction &inst = add_instruction(spv::OpFunctionCall, convert_type(res_type));
+		spirv_instruction inst = add_instruction(spv::OpFunctionCall, convert_type(res_type));
 		inst.add(function); // Function
 		for (const expression &arg : args)
 			inst.add(arg.base); // Arguments
@@ -2324,7 +2545,7 @@ private:
 			// Turn the list of scalar arguments into a list of column vectors
 			for (size_t arg = 0; arg < args.size(); arg += vector_type.rows)
 			{
-				spirv_instruction &inst = add_instruction(spv::OpCompositeConstruct, convert_type(vector_type));
+				spirv_instruction inst = add_instruction(spv::OpCompositeConstruct, convert_type(vector_type));
 				for (unsigned int row = 0; row < vector_type.rows; ++row)
 					inst.add(args[arg + row].base);
 
@@ -2340,7 +2561,7 @@ private:
 				ids.push_back(arg.base);
 		}
 
-		spirv_instruction &inst = add_instruction(spv::OpCompositeConstruct, convert_type(res_type));
+		spirv_instruction inst = add_instruction(spv::OpCompositeConstruct, convert_type(res_type));
 		inst.add(ids.begin(), ids.end());
 
 		return inst;
@@ -2348,16 +2569,15 @@ private:
 
 	void emit_if(const location &loc, id, id condition_block, id true_statement_block, id false_statement_block, unsigned int selection_control) override
 	{
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		assert(_current_block_data->back().op() == spv::OpLabel);
+		const spv::Id merge_label = _current_block_data->back().result();
+		_current_block_data->pop_back();
 
 		// Add previous block containing the condition value first
 		_current_block_data->append(_block_data[condition_block]);
 
-		spirv_instruction branch_inst = _current_block_data->instructions.back();
-		assert(branch_inst.op == spv::OpBranchConditional);
-		_current_block_data->instructions.pop_back();
+		const size_t branch_index = _current_block_data->size() - 1;
+		assert(_current_block_data->back().op() == spv::OpBranchConditional);
 
 		// Add structured control flow instruction
 		add_location(loc, *_current_block_data);
@@ -2366,17 +2586,17 @@ private:
 			.add(selection_control & 0x3); // 'SelectionControl' happens to match the flags produced by the parser
 
 		// Append all blocks belonging to the branch
-		_current_block_data->instructions.push_back(branch_inst);
+		_current_block_data->move_to_back(branch_index);
 		_current_block_data->append(_block_data[true_statement_block]);
 		_current_block_data->append(_block_data[false_statement_block]);
 
-		_current_block_data->instructions.push_back(merge_label);
+		_current_block_data->add_instruction(spv::OpLabel, 0, merge_label);
 	}
 	id   emit_phi(const location &loc, id, id condition_block, id true_value, id true_statement_block, id false_value, id false_statement_block, const type &res_type) override
 	{
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		assert(_current_block_data->back().op() == spv::OpLabel);
+		const spv::Id merge_label = _current_block_data->back().result();
+		_current_block_data->pop_back();
 
 		// Add previous block containing the condition value first
 		_current_block_data->append(_block_data[condition_block]);
@@ -2386,12 +2606,12 @@ private:
 		if (false_statement_block != condition_block)
 			_current_block_data->append(_block_data[false_statement_block]);
 
-		_current_block_data->instructions.push_back(merge_label);
+		_current_block_data->add_instruction(spv::OpLabel, 0, merge_label);
 
 		add_location(loc, *_current_block_data);
 
 		// https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html#OpPhi
-		spirv_instruction &inst = add_instruction(spv::OpPhi, convert_type(res_type))
+		spirv_instruction inst = add_instruction(spv::OpPhi, convert_type(res_type))
 			.add(true_value) // Variable 0
 			.add(true_statement_block) // Parent 0
 			.add(false_value) // Variable 1
@@ -2401,17 +2621,20 @@ private:
 	}
 	void emit_loop(const location &loc, id, id prev_block, id header_block, id condition_block, id loop_block, id continue_block, unsigned int loop_control) override
 	{
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		assert(_current_block_data->back().op() == spv::OpLabel);
+		const spv::Id merge_label = _current_block_data->back().result();
+		_current_block_data->pop_back();
 
 		// Add previous block first
 		_current_block_data->append(_block_data[prev_block]);
 
 		// Fill header block
-		assert(_block_data[header_block].instructions.size() == 2);
-		_current_block_data->instructions.push_back(_block_data[header_block].instructions[0]);
-		assert(_current_block_data->instructions.back().op == spv::OpLabel);
+		assert(_block_data[header_block].size() == 2);
+		_current_block_data->append(_block_data[header_block]);
+
+		const size_t branch_index = _current_block_data->size() - 1;
+		assert((*_current_block_data)[branch_index - 1].op() == spv::OpLabel);
+		assert((*_current_block_data)[branch_index].op() == spv::OpBranch);
 
 		// Add structured control flow instruction
 		add_location(loc, *_current_block_data);
@@ -2420,8 +2643,7 @@ private:
 			.add(continue_block)
 			.add(loop_control & 0x3); // 'LoopControl' happens to match the flags produced by the parser
 
-		_current_block_data->instructions.push_back(_block_data[header_block].instructions[1]);
-		assert(_current_block_data->instructions.back().op == spv::OpBranch);
+		_current_block_data->move_to_back(branch_index);
 
 		// Add condition block if it exists
 		if (condition_block != 0)
@@ -2431,22 +2653,21 @@ private:
 		_current_block_data->append(_block_data[loop_block]);
 		_current_block_data->append(_block_data[continue_block]);
 
-		_current_block_data->instructions.push_back(merge_label);
+		_current_block_data->add_instruction(spv::OpLabel, 0, merge_label);
 	}
 	void emit_switch(const location &loc, id, id selector_block, id default_label, id default_block, const std::vector<id> &case_literal_and_labels, const std::vector<id> &case_blocks, unsigned int selection_control) override
 	{
 		assert(case_blocks.size() == case_literal_and_labels.size() / 2);
 
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		assert(_current_block_data->back().op() == spv::OpLabel);
+		const spv::Id merge_label = _current_block_data->back().result();
+		_current_block_data->pop_back();
 
 		// Add previous block containing the selector value first
 		_current_block_data->append(_block_data[selector_block]);
 
-		spirv_instruction switch_inst = _current_block_data->instructions.back();
-		assert(switch_inst.op == spv::OpSwitch);
-		_current_block_data->instructions.pop_back();
+		const size_t switch_index = _current_block_data->size() - 1;
+		assert(_current_block_data->back().op() == spv::OpSwitch);
 
 		// Add structured control flow instruction
 		add_location(loc, *_current_block_data);
@@ -2455,12 +2676,11 @@ private:
 			.add(selection_control & 0x3); // 'SelectionControl' happens to match the flags produced by the parser
 
 		// Update switch instruction to contain all case labels
-		switch_inst.operands[1] = default_label;
+		spirv_instruction switch_inst = _current_block_data->move_to_back(switch_index);
+		switch_inst.operand(1) = default_label;
 		switch_inst.add(case_literal_and_labels.begin(), case_literal_and_labels.end());
 
 		// Append all blocks belonging to the switch
-		_current_block_data->instructions.push_back(switch_inst);
-
 		std::vector<id> blocks = case_blocks;
 		if (default_label != merge_label)
 			blocks.push_back(default_block);
@@ -2470,11 +2690,13 @@ private:
 		for (const id case_block : blocks)
 			_current_block_data->append(_block_data[case_block]);
 
-		_current_block_data->instructions.push_back(merge_label);
+		_current_block_data->add_instruction(spv::OpLabel, 0, merge_label);
 	}
 
-	void emit_pragma(const std::string &) override
+	void emit_pragma(const std::string &pragma) override
 	{
+		if (pragma == "reshade skipoptimization" || pragma == "reshade nooptimization")
+			_optimization_level = -1;
 	}
 
 	bool is_in_function() const { return _current_function_blocks != nullptr; }
@@ -2495,7 +2717,7 @@ private:
 
 		set_block(id);
 
-		add_instruction_without_result(spv::OpLabel).result = id;
+		_current_block_data->add_instruction(spv::OpLabel, 0, id);
 	}
 	id   leave_block_and_kill() override
 	{
@@ -2576,7 +2798,7 @@ private:
 	{
 		assert(is_in_function()); // Can only leave if there was a function to begin with
 
-		_current_function_blocks->definition = _block_data[_last_block];
+		_current_function_blocks->definition = std::move(_block_data[_last_block]);
 
 		// Append function end instruction
 		add_instruction_without_result(spv::OpFunctionEnd, _current_function_blocks->definition);
@@ -2587,8 +2809,8 @@ private:
 };
 
 #ifndef RESHADEFX_CODEGEN_SPIRV_INLINE
-codegen *reshadefx::create_codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y)
+codegen *reshadefx::create_codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y, int optimization_level)
 {
-	return new codegen_spirv(vulkan_semantics, debug_info, uniforms_to_spec_constants, enable_16bit_types, flip_vert_y);
+	return new codegen_spirv(vulkan_semantics, debug_info, uniforms_to_spec_constants, enable_16bit_types, flip_vert_y, optimization_level);
 }
 #endif
@@ -6,8 +6,18 @@
 #include "effect_lexer.hpp"
 #include <cassert>
 #include <charconv> // std::from_chars
+#include <cstring> // std::memchr
 #include <string_view>
 #include <unordered_map> // Used for static lookup tables
+#include <vector>
+#include <algorithm> // std::find, std::stable_sort
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define RESHADEFX_LEXER_SSE2 1
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h> // _BitScanForward
+#endif
+#endif
 
 using namespace reshadefx;
 
@@ -35,6 +45,200 @@ static const unsigned int s_type_lookup[256] = {
 	IDENT, IDENT, IDENT,   '{',   '|',   '}',   '~',  0x00,  0x00,  0x00,
 };
 
+#if RESHADEFX_LEXER_SSE2
+static inline unsigned int find_first_set_bit(unsigned int mask)
+{
+	assert(mask != 0);
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+static inline __m128i is_in_range(__m128i chars, char first, char last)
+{
+	// Characters outside the ASCII range are negative as signed bytes, so never fall into any of the tested ranges
+	return _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8(first - 1)), _mm_cmplt_epi8(chars, _mm_set1_epi8(last + 1)));
+}
+#endif
+
+// Fast paths which scan runs of characters 16 at a time, only reading full blocks that lie before the end of the input and falling back to the lookup table for the rest
+
+static const char *find_space_end(const char *cur, const char *end)
+{
+#if RESHADEFX_LEXER_SSE2
+	for (; end - cur >= 16; cur += 16)
+	{
+		const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur));
+		const __m128i space = _mm_or_si128(
+			_mm_cmpeq_epi8(chars, _mm_set1_epi8(' ')),
+			_mm_andnot_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')), is_in_range(chars, '\t', '\r')));
+		if (const unsigned int mask = ~_mm_movemask_epi8(space) & 0xFFFF)
+			return cur + find_first_set_bit(mask);
+	}
+#endif
+	while (cur < end && s_type_lookup[uint8_t(*cur)] == SPACE)
+		cur++;
+	return cur;
+}
+static const char *find_identifier_end(const char *cur, const char *end)
+{
+#if RESHADEFX_LEXER_SSE2
+	for (; end - cur >= 16; cur += 16)
+	{
+		const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur));
+		const __m128i ident = _mm_or_si128(
+			_mm_or_si128(
+				is_in_range(_mm_or_si128(chars, _mm_set1_epi8(0x20)), 'a', 'z'), // Fold upper case to lower case letters
+				is_in_range(chars, '0', '9')),
+			_mm_cmpeq_epi8(chars, _mm_set1_epi8('_')));
+		if (const unsigned int mask = ~_mm_movemask_epi8(ident) & 0xFFFF)
+			return cur + find_first_set_bit(mask);
+	}
+#endif
+	while (cur < end && (s_type_lookup[uint8_t(*cur)] == IDENT || s_type_lookup[uint8_t(*cur)] == DIGIT))
+		cur++;
+	return cur;
+}
+static const char *find_multi_line_comment_special(const char *cur, const char *end)
+{
+	// Only line feeds (to keep track of the location) and stars (which may close the comment) need attention inside multi-line comments
+#if RESHADEFX_LEXER_SSE2
+	for (; end - cur >= 16; cur += 16)
+	{
+		const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur));
+		const __m128i special = _mm_or_si128(
+			_mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')),
+			_mm_cmpeq_epi8(chars, _mm_set1_epi8('*')));
+		if (const unsigned int mask = _mm_movemask_epi8(special))
+			return cur + find_first_set_bit(mask);
+	}
+#endif
+	while (cur < end && *cur != '\n' && *cur != '*')
+		cur++;
+	return cur;
+}
+static const char *find_string_literal_special(const char *cur, const char *end)
+{
+	// Anything but quotes, line feeds, carriage returns and escape characters is copied verbatim into string literals
+#if RESHADEFX_LEXER_SSE2
+	for (; end - cur >= 16; cur += 16)
+	{
+		const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur));
+		const __m128i special = _mm_or_si128(
+			_mm_or_si128(
+				_mm_cmpeq_epi8(chars, _mm_set1_epi8('"')),
+				_mm_cmpeq_epi8(chars, _mm_set1_epi8('\\'))),
+			_mm_or_si128(
+				_mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')),
+				_mm_cmpeq_epi8(chars, _mm_set1_epi8('\r'))));
+		if (const unsigned int mask = _mm_movemask_epi8(special))
+			return cur + find_first_set_bit(mask);
+	}
+#endif
+	while (cur < end && *cur != '"' && *cur != '\\' && *cur != '\n' && *cur != '\r')
+		cur++;
+	return cur;
+}
+
+// Perfect hash table (built with the hash and displace algorithm on startup), so that looking up an identifier only costs a single hash and string comparison
+class keyword_table
+{
+public:
+	keyword_table(std::initializer_list<std::pair<std::string_view, tokenid>> keywords)
+	{
+		size_t num_buckets = 1, num_slots = 1;
+		while (num_buckets * 2 < keywords.size())
+			num_buckets *= 2;
+		while (num_slots < keywords.size() * 2)
+			num_slots *= 2;
+
+		std::vector<std::vector<std::pair<std::string_view, tokenid>>> buckets(num_buckets);
+		for (const std::pair<std::string_view, tokenid> &keyword : keywords)
+			buckets[hash(keyword.first) & (num_buckets - 1)].push_back(keyword);
+
+		_seeds.resize(num_buckets);
+		_slots.resize(num_slots);
+
+		// Place the largest buckets first, while the table is still mostly empty
+		std::vector<size_t> bucket_order(num_buckets);
+		for (size_t i = 0; i < num_buckets; ++i)
+			bucket_order[i] = i;
+		std::stable_sort(bucket_order.begin(), bucket_order.end(),
+			[&buckets](size_t lhs, size_t rhs) { return buckets[lhs].size() > buckets[rhs].size(); });
+
+		std::vector<size_t> bucket_slots;
+		for (const size_t bucket_index : bucket_order)
+		{
+			const std::vector<std::pair<std::string_view, tokenid>> &bucket = buckets[bucket_index];
+			if (bucket.empty())
+				break;
+
+			// Search for a seed that maps all keywords in this bucket to distinct free slots
+			for (uint32_t seed = 1; true; ++seed)
+			{
+				assert(seed < 0x10000);
+
+				bucket_slots.clear();
+				for (const std::pair<std::string_view, tokenid> &keyword : bucket)
+				{
+					const size_t slot = mix(hash(keyword.first), seed) & (num_slots - 1);
+					if (!_slots[slot].name.empty() || std::find(bucket_slots.begin(), bucket_slots.end(), slot) != bucket_slots.end())
+						break;
+					bucket_slots.push_back(slot);
+				}
+
+				if (bucket_slots.size() == bucket.size())
+				{
+					_seeds[bucket_index] = seed;
+					for (size_t i = 0; i < bucket.size(); ++i)
+						_slots[bucket_slots[i]] = { bucket[i].first, bucket[i].second };
+					break;
+				}
+			}
+		}
+	}
+
+	const tokenid *find(std::string_view name) const
+	{
+		const uint32_t name_hash = hash(name);
+		const entry &slot = _slots[mix(name_hash, _seeds[name_hash & (_seeds.size() - 1)]) & (_slots.size() - 1)];
+		return slot.name == name ? &slot.id : nullptr;
+	}
+
+private:
+	struct entry
+	{
+		std::string_view name;
+		tokenid id;
+	};
+
+	static uint32_t hash(std::string_view name)
+	{
+		// FNV-1a hash
+		uint32_t value = 2166136261u;
+		for (const char c : name)
+			value = (value ^ uint8_t(c)) * 16777619u;
+		return value;
+	}
+	static uint32_t mix(uint32_t value, uint32_t seed)
+	{
+		value ^= seed * 0x9E3779B9u;
+		value ^= value >> 16;
+		value *= 0x85EBCA6Bu;
+		value ^= value >> 13;
+		value *= 0xC2B2AE35u;
+		value ^= value >> 16;
+		return value;
+	}
+
+	std::vector<uint32_t> _seeds;
+	std::vector<entry> _slots;
+};
+
 // Lookup tables which translate a given string literal to a token and backwards
 static const std::unordered_map<tokenid, std::string_view> s_token_lookup = {
 	{ tokenid::end_of_file, "end of file" },
@@ -233,7 +437,7 @@ static const std::unordered_map<tokenid, std::string_view> s_token_lookup = {
 	{ tokenid::storage2d, "storage2D" },
 	{ tokenid::storage3d, "storage3D" },
 };
-static const std::unordered_map<std::string_view, tokenid> s_keyword_lookup = {
+static const keyword_table s_keyword_lookup = {
 	{ "_Pragma", tokenid::pragma },
 	{ "asm", tokenid::reserved },
 	{ "asm_fragment", tokenid::reserved },
@@ -495,7 +699,7 @@ static const std::unordered_map<std::string_view, tokenid> s_keyword_lookup = {
 	{ "volatile", tokenid::volatile_ },
 	{ "while", tokenid::while_ }
 };
-static const std::unordered_map<std::string_view, tokenid> s_pp_directive_lookup = {
+static const keyword_table s_pp_directive_lookup = {
 	{ "define", tokenid::hash_def },
 	{ "undef", tokenid::hash_undef },
 	{ "if", tokenid::hash_if },
@@ -713,6 +917,11 @@ next_token:
 		{
 			while (_cur < _end)
 			{
+				// Skip over all characters that cannot affect the location or end the comment at once
+				skip(find_multi_line_comment_special(_cur, _end) - _cur);
+				if (_cur >= _end)
+					break;
+
 				if (*_cur == '\n')
 				{
 					_cur_location.line++;
@@ -861,28 +1070,19 @@ void reshadefx::lexer::skip_space()
 			continue;
 		}
 
-		if (s_type_lookup[uint8_t(*_cur)] == SPACE)
-			skip(1);
+		if (const char *const space_end = find_space_end(_cur, _end); space_end != _cur)
+			skip(space_end - _cur);
 		else
 			break;
 	}
 }
 void reshadefx::lexer::skip_to_next_line()
 {
-	// Skip each character until a new line feed is found
-	while (*_cur != '\n' && _cur < _end)
+	// Skip all characters until a new line feed is found
+	if (_cur < _end)
 	{
-#if 0
-		if (_cur[0] == '\\' && (_cur[1] == '\n' || (_cur[1] == '\r' && _cur[2] == '\n')))
-		{
-			skip(_cur[1] == '\r' ? 3 : 2);
-			_cur_location.line++;
-			_cur_location.column = 1;
-			continue;
-		}
-#endif
-
-		skip(1);
+		const void *const line_end = std::memchr(_cur, '\n', _end - _cur);
+		skip((line_end != nullptr ? static_cast<const char *>(line_end) : _end) - _cur);
 	}
 }
 
@@ -897,8 +1097,7 @@ void reshadefx::lexer::parse_identifier(token &tok) const
 	auto *const begin = _cur, *end = begin;
 
 	// Skip to the end of the identifier sequence
-	while (s_type_lookup[uint8_t(*end)] == IDENT || s_type_lookup[uint8_t(*end)] == DIGIT)
-		end++;
+	end = find_identifier_end(end, _end);
 
 	tok.id = tokenid::identifier;
 	tok.offset = input_offset();
@@ -908,9 +1107,8 @@ void reshadefx::lexer::parse_identifier(token &tok) const
 	if (_ignore_keywords)
 		return;
 
-	if (const auto it = s_keyword_lookup.find(tok.literal_as_string);
-		it != s_keyword_lookup.end())
-		tok.id = it->second;
+	if (const tokenid *const keyword = s_keyword_lookup.find(tok.literal_as_string))
+		tok.id = *keyword;
 }
 bool reshadefx::lexer::parse_pp_directive(token &tok)
 {
@@ -918,10 +1116,9 @@ bool reshadefx::lexer::parse_pp_directive(token &tok)
 	skip_space(); // Skip any space between the '#' and directive
 	parse_identifier(tok);
 
-	if (const auto it = s_pp_directive_lookup.find(tok.literal_as_string);
-		it != s_pp_directive_lookup.end())
+	if (const tokenid *const directive = s_pp_directive_lookup.find(tok.literal_as_string))
 	{
-		tok.id = it->second;
+		tok.id = *directive;
 		return true;
 	}
 	else if (!_ignore_line_directives && tok.literal_as_string == "line") // The #line directive needs special handling
@@ -962,6 +1159,15 @@ void reshadefx::lexer::parse_string_literal(token &tok, bool escape)
 
 	for (auto c = *end; c != '"'; c = *++end)
 	{
+		// Append all characters that need no special handling at once
+		if (const char *const special = find_string_literal_special(end, _end); special != end)
+		{
+			tok.literal_as_string.append(end, special);
+			end = special;
+			if ((c = *end) == '"')
+				break;
+		}
+
 		if (c == '\n' || end >= _end)
 		{
 			// Line feed reached, the string literal is done (technically this should be an error, but the lexer does not report errors, so ignore it)
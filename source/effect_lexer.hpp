@@ -6,6 +6,8 @@
 #pragma once
 
 #include "effect_token.hpp"
+#include <memory> // std::shared_ptr
+#include <string_view>
 
 namespace reshadefx
 {
@@ -24,7 +26,7 @@ namespace reshadefx
 			bool ignore_keywords = false,
 			bool escape_string_literals = true,
 			const location &start_location = location()) :
-			_input(std::move(input)),
+			_input_storage(std::move(input)),
 			_cur_location(start_location),
 			_ignore_comments(ignore_comments),
 			_ignore_whitespace(ignore_whitespace),
@@ -33,6 +35,32 @@ namespace reshadefx
 			_ignore_keywords(ignore_keywords),
 			_escape_string_literals(escape_string_literals)
 		{
+			_input = _input_storage;
+			_cur = _input.data();
+			_end = _cur + _input.size();
+		}
+		/// <summary>
+		/// Constructs a lexical analyzer that works directly on a shared read-only input string, without copying it.
+		/// </summary>
+		explicit lexer(
+			std::shared_ptr<const std::string> input,
+			bool ignore_comments = true,
+			bool ignore_whitespace = true,
+			bool ignore_pp_directives = true,
+			bool ignore_line_directives = false,
+			bool ignore_keywords = false,
+			bool escape_string_literals = true,
+			const location &start_location = location()) :
+			_shared_input(std::move(input)),
+			_cur_location(start_location),
+			_ignore_comments(ignore_comments),
+			_ignore_whitespace(ignore_whitespace),
+			_ignore_pp_directives(ignore_pp_directives),
+			_ignore_line_directives(ignore_line_directives),
+			_ignore_keywords(ignore_keywords),
+			_escape_string_literals(escape_string_literals)
+		{
+			_input = *_shared_input;
 			_cur = _input.data();
 			_end = _cur + _input.size();
 		}
@@ -40,7 +68,9 @@ namespace reshadefx
 		lexer(const lexer &lexer) { operator=(lexer); }
 		lexer &operator=(const lexer &lexer)
 		{
-			_input = lexer._input;
+			_input_storage = lexer._input_storage;
+			_shared_input = lexer._shared_input;
+			_input = _shared_input != nullptr ? std::string_view(*_shared_input) : std::string_view(_input_storage);
 			_cur_location = lexer._cur_location;
 			reset_to_offset(lexer._cur - lexer._input.data());
 			_end = _input.data() + _input.size();
@@ -62,8 +92,8 @@ namespace reshadefx
 		/// <summary>
 		/// Gets the input string this lexical analyzer works on.
 		/// </summary>
-		/// <returns>Constant reference to the input string.</returns>
-		const std::string &input_string() const { return _input; }
+		/// <returns>View of the input string.</returns>
+		std::string_view input_string() const { return _input; }
 
 		/// <summary>
 		/// Performs lexical analysis on the input string and return the next token in sequence.
@@ -98,7 +128,9 @@ namespace reshadefx
 		void parse_string_literal(token &tok, bool escape);
 		void parse_numeric_literal(token &tok) const;
 
-		std::string _input;
+		std::string _input_storage;
+		std::shared_ptr<const std::string> _shared_input;
+		std::string_view _input;
 		location _cur_location;
 		const std::string::value_type *_cur, *_end;
 
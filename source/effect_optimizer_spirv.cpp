@@ -0,0 +1,936 @@
+/*
+ * Copyright (C) 2026 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause OR MIT
+ */
+
+#include "effect_codegen.hpp"
+#include <map>
+#include <cmath> // std::isfinite
+#include <cstdint>
+#include <cstring> // std::memcpy
+#include <unordered_map>
+
+// Use the C++ variant of the SPIR-V headers
+#include <spirv.hpp>
+
+/// <summary>
+/// Optimizer operating on a fully assembled SPIR-V module with a single entry point, as generated by the SPIR-V code generation back-end.
+/// It only needs to understand the subset of SPIR-V that back-end emits.
+/// </summary>
+class spirv_optimizer
+{
+public:
+	explicit spirv_optimizer(std::vector<uint32_t> &words) : _words(words) {}
+
+	bool parse()
+	{
+		// Module has to at least contain the header
+		if (_words.size() < 5 || _words[0] != spv::MagicNumber)
+			return false;
+
+		_bound = _words[3];
+		_definitions.assign(_bound, 0);
+		_scalar_types.assign(_bound, scalar_type::none);
+
+		for (size_t offset = 5; offset < _words.size();)
+		{
+			instruction inst;
+			inst.offset = static_cast<uint32_t>(offset);
+			inst.op = static_cast<spv::Op>(_words[offset] & spv::OpCodeMask);
+			inst.word_count = _words[offset] >> spv::WordCountShift;
+
+			if (inst.word_count == 0 || offset + inst.word_count > _words.size())
+				return false; // Malformed module
+
+			bool has_type, has_result;
+			get_instruction_layout(inst.op, has_type, has_result);
+			inst.first_operand = 1 + has_type + has_result;
+			if (inst.first_operand > inst.word_count)
+				return false;
+
+			const size_t index = _instructions.size();
+
+			if (has_result)
+			{
+				const spv::Id result = _words[offset + inst.first_operand - 1];
+				if (result >= _bound)
+					return false;
+				_definitions[result] = static_cast<uint32_t>(index + 1);
+			}
+
+			switch (inst.op)
+			{
+			case spv::OpFunction:
+				if (_first_function == 0)
+					_first_function = index;
+				break;
+			case spv::OpTypeBool:
+				_scalar_types[_words[offset + 1]] = scalar_type::boolean;
+				break;
+			case spv::OpTypeInt:
+				if (inst.word_count == 4 && _words[offset + 2] == 32)
+					_scalar_types[_words[offset + 1]] = _words[offset + 3] ? scalar_type::sint : scalar_type::uint;
+				break;
+			case spv::OpTypeFloat:
+				if (inst.word_count == 3 && _words[offset + 2] == 32)
+					_scalar_types[_words[offset + 1]] = scalar_type::floating;
+				break;
+			case spv::OpConstant:
+				if (inst.word_count == 4)
+					_scalar_constants.emplace((static_cast<uint64_t>(_words[offset + 1]) << 32) | _words[offset + 3], _words[offset + 2]);
+				break;
+			case spv::OpConstantTrue:
+			case spv::OpConstantFalse:
+				_scalar_constants.emplace((static_cast<uint64_t>(_words[offset + 1]) << 32) | (inst.op == spv::OpConstantTrue), _words[offset + 2]);
+				break;
+			case spv::OpConstantComposite:
+				_composite_constants.emplace(make_composite_key(_words[offset + 1], _words.data() + offset + 3, inst.word_count - 3), _words[offset + 2]);
+				break;
+			case spv::OpVariable:
+				_variable_storage.emplace(_words[offset + 2], static_cast<spv::StorageClass>(_words[offset + 3]));
+				break;
+			default:
+				break;
+			}
+
+			_instructions.push_back(inst);
+
+			offset += inst.word_count;
+		}
+
+		// A module without any functions is not valid, so do not bother with it
+		if (_first_function == 0)
+			return false;
+
+		_num_module_instructions = _instructions.size();
+
+		return true;
+	}
+
+	/// <summary>
+	/// Forwards values stored to or loaded from variables to subsequent loads in the same basic block and folds operations on constant values, replacing all references to their results.
+	/// This leaves the original instructions unreferenced, so that they are removed by <see cref="eliminate_dead_code"/> afterwards.
+	/// </summary>
+	void forward_and_fold_values()
+	{
+		std::vector<spv::Id> replacements(_bound, 0);
+		std::unordered_map<spv::Id, spv::Id> known_values; // Maps variables to the value they currently hold
+		std::unordered_map<spv::Id, spv::Id> pointer_roots; // Maps access chains to the variable they point into
+
+		const auto substitute = [&replacements](spv::Id &id) {
+			if (id < replacements.size() && replacements[id] != 0)
+				id = replacements[id];
+		};
+		const auto find_root = [this, &pointer_roots](spv::Id pointer) -> spv::Id {
+			if (_variable_storage.find(pointer) != _variable_storage.end())
+				return pointer;
+			if (const auto it = pointer_roots.find(pointer);
+				it != pointer_roots.end())
+				return it->second;
+			return 0;
+		};
+		const auto forget_writable_values = [this, &known_values]() {
+			for (auto it = known_values.begin(); it != known_values.end();)
+				if (is_writable_storage(_variable_storage.at(it->first)))
+					it = known_values.erase(it);
+				else
+					++it;
+		};
+
+		// Constants that are added while folding are appended to the end of the instruction list and never need to be visited here
+		for (size_t i = _first_function; i < _num_module_instructions; ++i)
+		{
+			for_each_id_operand(i, substitute);
+
+			const instruction inst = _instructions[i];
+			const uint32_t *const operands = _words.data() + inst.offset + inst.first_operand;
+			const spv::Id result = inst.first_operand == 3 ? operands[-1] : 0;
+
+			switch (inst.op)
+			{
+			case spv::OpFunction:
+			case spv::OpLabel:
+				// Values are only forwarded within a single basic block
+				known_values.clear();
+				continue;
+			case spv::OpAccessChain:
+				if (const spv::Id root = find_root(operands[0]))
+					pointer_roots.emplace(result, root);
+				continue;
+			case spv::OpStore:
+				if (is_forwardable_variable(operands[0]))
+					known_values[operands[0]] = operands[1];
+				else if (const spv::Id root = find_root(operands[0]))
+					known_values.erase(root);
+				else
+					forget_writable_values(); // Pointer of unknown origin (e.g. a function parameter) may alias any variable
+				continue;
+			case spv::OpLoad:
+				if (is_forwardable_variable(operands[0]))
+				{
+					if (const auto it = known_values.find(operands[0]);
+						it != known_values.end())
+						replacements[result] = it->second;
+					else
+						known_values.emplace(operands[0], result);
+				}
+				continue;
+			case spv::OpFunctionCall:
+				// Called function may modify any global variables or variables passed in as arguments
+				forget_writable_values();
+				continue;
+			default:
+				// Any other instruction taking a pointer may write through it (e.g. atomics or extended instructions with output parameters), so treat it like a store
+				{
+					bool unknown_pointer = false;
+					for_each_id_operand(i, [&](spv::Id &id) {
+						if (const spv::Id root = find_root(id))
+							known_values.erase(root);
+						else if (is_pointer(id))
+							unknown_pointer = true;
+					});
+					if (unknown_pointer)
+						forget_writable_values();
+				}
+				break;
+			}
+
+			// Folding may add new constants, which invalidates the 'operands' pointer
+			if (result != 0)
+			{
+				if (const spv::Id value = fold(i))
+					replacements[result] = value;
+			}
+		}
+
+		// Update references again that were made before the value they refer to was replaced (e.g. in phi instructions of loops)
+		for (size_t i = _first_function; i < _num_module_instructions; ++i)
+			for_each_id_operand(i, substitute);
+	}
+
+	/// <summary>
+	/// Removes all functions, variables, types, constants and instructions that are not referenced from the entry point, together with their names and decorations.
+	/// </summary>
+	void eliminate_dead_code()
+	{
+		std::vector<bool> live_ids(_bound, false);
+		std::vector<bool> live_instructions(_instructions.size(), false);
+		std::vector<size_t> worklist;
+
+		const auto mark_instruction = [&](size_t index) {
+			if (live_instructions[index])
+				return;
+			live_instructions[index] = true;
+			worklist.push_back(index);
+		};
+		const auto mark_id = [&](spv::Id &id) {
+			if (id >= _bound || live_ids[id])
+				return;
+			live_ids[id] = true;
+			if (_definitions[id] != 0)
+				mark_instruction(_definitions[id] - 1);
+		};
+
+		// Anything in global scope without a result is required (capabilities, entry point declaration, ...), except for names and decorations, which are only kept if their target is
+		for (size_t i = 0; i < _first_function; ++i)
+			if (_instructions[i].first_operand == 1 && !is_debug_or_annotation(_instructions[i].op))
+				mark_instruction(i);
+
+		while (!worklist.empty())
+		{
+			const size_t index = worklist.back();
+			worklist.pop_back();
+
+			const instruction &inst = _instructions[index];
+
+			if (inst.first_operand == 3)
+				mark_id(_words[inst.offset + 1]); // Result type
+			for_each_id_operand(index, mark_id);
+
+			// Referencing a function makes all of its instructions that have side effects required too, which in turn pulls in any values they use
+			if (inst.op == spv::OpFunction)
+			{
+				for (size_t i = index + 1; i < _num_module_instructions; ++i)
+				{
+					if (!is_removable_from_function(_instructions[i]))
+						mark_instruction(i);
+					if (_instructions[i].op == spv::OpFunctionEnd)
+						break;
+				}
+			}
+		}
+
+		std::vector<uint32_t> output;
+		output.reserve(_words.size());
+		output.insert(output.end(), _words.begin(), _words.begin() + 5);
+		output[3] = _bound;
+
+		const auto write_instruction = [&](size_t index) {
+			const instruction &inst = _instructions[index];
+			if (!live_instructions[index] && !(is_debug_or_annotation(inst.op) && live_ids[_words[inst.offset + 1]]))
+				return;
+			output.insert(output.end(), _words.begin() + inst.offset, _words.begin() + inst.offset + inst.word_count);
+		};
+
+		// Constants added by folding are placed at the end of the global section, after everything they could depend on
+		for (size_t i = 0; i < _first_function; ++i)
+			write_instruction(i);
+		for (size_t i = _num_module_instructions; i < _instructions.size(); ++i)
+			write_instruction(i);
+		for (size_t i = _first_function; i < _num_module_instructions; ++i)
+			write_instruction(i);
+
+		_words = std::move(output);
+	}
+
+private:
+	enum class scalar_type : uint8_t
+	{
+		none,
+		boolean,
+		sint,
+		uint,
+		floating,
+	};
+
+	struct instruction
+	{
+		uint32_t offset;
+		spv::Op op;
+		uint32_t word_count;
+		uint32_t first_operand;
+	};
+
+	static void get_instruction_layout(spv::Op op, bool &has_type, bool &has_result)
+	{
+		switch (op)
+		{
+		case spv::OpNop:
+		case spv::OpSourceContinued:
+		case spv::OpSource:
+		case spv::OpName:
+		case spv::OpMemberName:
+		case spv::OpLine:
+		case spv::OpCapability:
+		case spv::OpMemoryModel:
+		case spv::OpEntryPoint:
+		case spv::OpExecutionMode:
+		case spv::OpDecorate:
+		case spv::OpMemberDecorate:
+		case spv::OpStore:
+		case spv::OpFunctionEnd:
+		case spv::OpImageWrite:
+		case spv::OpControlBarrier:
+		case spv::OpMemoryBarrier:
+		case spv::OpSelectionMerge:
+		case spv::OpLoopMerge:
+		case spv::OpBranch:
+		case spv::OpBranchConditional:
+		case spv::OpSwitch:
+		case spv::OpKill:
+		case spv::OpReturn:
+		case spv::OpReturnValue:
+			has_type = false;
+			has_result = false;
+			break;
+		case spv::OpString:
+		case spv::OpExtInstImport:
+		case spv::OpTypeVoid:
+		case spv::OpTypeBool:
+		case spv::OpTypeInt:
+		case spv::OpTypeFloat:
+		case spv::OpTypeVector:
+		case spv::OpTypeMatrix:
+		case spv::OpTypeImage:
+		case spv::OpTypeSampledImage:
+		case spv::OpTypeArray:
+		case spv::OpTypeStruct:
+		case spv::OpTypePointer:
+		case spv::OpTypeFunction:
+		case spv::OpLabel:
+			has_type = false;
+			has_result = true;
+			break;
+		default:
+			has_type = true;
+			has_result = true;
+			break;
+		}
+	}
+
+	static bool is_debug_or_annotation(spv::Op op)
+	{
+		return op == spv::OpName || op == spv::OpMemberName || op == spv::OpDecorate || op == spv::OpMemberDecorate;
+	}
+	static bool is_writable_storage(spv::StorageClass storage)
+	{
+		return storage == spv::StorageClassFunction || storage == spv::StorageClassPrivate;
+	}
+	bool is_forwardable_variable(spv::Id id) const
+	{
+		const auto it = _variable_storage.find(id);
+		if (it == _variable_storage.end())
+			return false;
+
+		// Other invocations can write to output and workgroup variables, so only forward loads from variables that are either private to this invocation or read-only
+		return is_writable_storage(it->second) || it->second == spv::StorageClassInput || it->second == spv::StorageClassUniform || it->second == spv::StorageClassUniformConstant;
+	}
+	bool is_pointer(spv::Id id) const
+	{
+		const instruction *const inst = find_definition(id);
+		if (inst == nullptr || inst->first_operand != 3)
+			return false;
+
+		const instruction *const type = find_definition(_words[inst->offset + 1]);
+		return type != nullptr && type->op == spv::OpTypePointer;
+	}
+	bool is_removable_from_function(const instruction &inst) const
+	{
+		switch (inst.op)
+		{
+		case spv::OpExtInst:
+			// Extended instructions with output parameters (e.g. 'modf' and 'frexp') write through a pointer operand, so have side effects even if their result is unused
+			for (uint32_t i = inst.first_operand + 2; i < inst.word_count; ++i)
+				if (is_pointer(_words[inst.offset + i]))
+					return false;
+			return true;
+		case spv::OpLabel:
+		case spv::OpFunctionParameter:
+		case spv::OpFunctionCall:
+		case spv::OpAtomicAnd:
+		case spv::OpAtomicCompareExchange:
+		case spv::OpAtomicExchange:
+		case spv::OpAtomicIAdd:
+		case spv::OpAtomicOr:
+		case spv::OpAtomicSMax:
+		case spv::OpAtomicSMin:
+		case spv::OpAtomicUMax:
+		case spv::OpAtomicUMin:
+		case spv::OpAtomicXor:
+			return false;
+		default:
+			// Instructions without a result only exist for their side effects (stores, control flow, ...)
+			return inst.first_operand == 3;
+		}
+	}
+
+	/// <summary>
+	/// Calls the specified function with a reference to every operand of the instruction at the specified <paramref name="index"/> that is an ID (rather than a literal).
+	/// </summary>
+	template <typename F>
+	void for_each_id_operand(size_t index, F fun)
+	{
+		const instruction &inst = _instructions[index];
+		uint32_t *const operands = _words.data() + inst.offset + inst.first_operand;
+		const uint32_t num_operands = inst.word_count - inst.first_operand;
+
+		uint32_t first = 0, last = num_operands; // Range of operands that are IDs
+		uint32_t literal = num_operands; // Index of a single literal operand in that range
+
+		switch (inst.op)
+		{
+		case spv::OpEntryPoint:
+			// Execution model, entry point function, name string and then interface variables
+			if (num_operands >= 2)
+				fun(operands[1]);
+			for (uint32_t i = 2 + string_word_count(operands + 2, num_operands - 2); i < num_operands; ++i)
+				fun(operands[i]);
+			return;
+		case spv::OpSource:
+			// Source language, version and then optional file name string
+			if (num_operands >= 3)
+				fun(operands[2]);
+			return;
+		case spv::OpSwitch:
+			// Selector, default label and then pairs of literals and labels
+			for (uint32_t i = 0; i < num_operands; ++i)
+				if (i < 2 || (i % 2) != 0)
+					fun(operands[i]);
+			return;
+		case spv::OpCapability:
+		case spv::OpMemoryModel:
+		case spv::OpSourceContinued:
+		case spv::OpString:
+		case spv::OpExtInstImport:
+		case spv::OpTypeVoid:
+		case spv::OpTypeBool:
+		case spv::OpTypeInt:
+		case spv::OpTypeFloat:
+		case spv::OpConstant:
+		case spv::OpConstantTrue:
+		case spv::OpConstantFalse:
+		case spv::OpConstantNull:
+		case spv::OpSpecConstant:
+		case spv::OpSpecConstantTrue:
+		case spv::OpSpecConstantFalse:
+		case spv::OpUndef:
+			return;
+		case spv::OpExecutionMode:
+		case spv::OpName:
+		case spv::OpMemberName:
+		case spv::OpLine:
+		case spv::OpDecorate:
+		case spv::OpMemberDecorate:
+		case spv::OpTypeVector:
+		case spv::OpTypeMatrix:
+		case spv::OpTypeImage:
+		case spv::OpTypeSampledImage:
+		case spv::OpCompositeExtract:
+		case spv::OpLoad:
+		case spv::OpImage:
+		case spv::OpImageQuerySize:
+		case spv::OpSelectionMerge:
+			last = 1;
+			break;
+		case spv::OpTypePointer:
+		case spv::OpVariable:
+		case spv::OpFunction:
+			first = 1;
+			last = 2;
+			break;
+		case spv::OpExtInst:
+			literal = 1;
+			break;
+		case spv::OpStore:
+		case spv::OpCompositeInsert:
+		case spv::OpVectorShuffle:
+		case spv::OpLoopMerge:
+		case spv::OpImageQuerySizeLod:
+			last = 2;
+			break;
+		case spv::OpBranchConditional:
+		case spv::OpImageTexelPointer:
+			last = 3;
+			break;
+		case spv::OpImageSampleImplicitLod:
+		case spv::OpImageSampleExplicitLod:
+		case spv::OpImageFetch:
+		case spv::OpImageRead:
+			literal = 2; // Image operands mask
+			break;
+		case spv::OpImageGather:
+		case spv::OpImageWrite:
+			literal = 3; // Image operands mask
+			break;
+		default:
+			break;
+		}
+
+		for (uint32_t i = first; i < last && i < num_operands; ++i)
+			if (i != literal)
+				fun(operands[i]);
+	}
+
+	static uint32_t string_word_count(const uint32_t *words, uint32_t max_word_count)
+	{
+		for (uint32_t i = 0; i < max_word_count; ++i)
+			// String ends in the first word that contains a null terminator
+			if ((words[i] & 0xFF) == 0 || (words[i] & 0xFF00) == 0 || (words[i] & 0xFF0000) == 0 || (words[i] & 0xFF000000) == 0)
+				return i + 1;
+		return max_word_count;
+	}
+
+	const instruction *find_definition(spv::Id id) const
+	{
+		if (id >= _definitions.size() || _definitions[id] == 0)
+			return nullptr;
+		return &_instructions[_definitions[id] - 1];
+	}
+
+	bool get_scalar_constant(spv::Id id, scalar_type &type, uint32_t &value) const
+	{
+		const instruction *const inst = find_definition(id);
+		if (inst == nullptr)
+			return false;
+
+		switch (inst->op)
+		{
+		case spv::OpConstant:
+			if (inst->word_count != 4)
+				return false;
+			value = _words[inst->offset + 3];
+			break;
+		case spv::OpConstantTrue:
+			value = 1;
+			break;
+		case spv::OpConstantFalse:
+			value = 0;
+			break;
+		default:
+			// Specialization constants may change their value, so cannot fold those
+			return false;
+		}
+
+		type = _scalar_types[_words[inst->offset + 1]];
+		return type != scalar_type::none;
+	}
+
+	static std::vector<uint32_t> make_composite_key(spv::Id type, const uint32_t *constituents, uint32_t num_constituents)
+	{
+		std::vector<uint32_t> key;
+		key.reserve(1 + num_constituents);
+		key.push_back(type);
+		key.insert(key.end(), constituents, constituents + num_constituents);
+		return key;
+	}
+
+	/// <summary>
+	/// Appends a new constant instruction to the module, which is written out at the end of the global section later.
+	/// </summary>
+	spv::Id add_constant(spv::Op op, spv::Id type, const uint32_t *operands, uint32_t num_operands)
+	{
+		const spv::Id result = _bound++;
+
+		instruction inst;
+		inst.offset = static_cast<uint32_t>(_words.size());
+		inst.op = op;
+		inst.word_count = 3 + num_operands;
+		inst.first_operand = 3;
+
+		_words.push_back((inst.word_count << spv::WordCountShift) | op);
+		_words.push_back(type);
+		_words.push_back(result);
+		_words.insert(_words.end(), operands, operands + num_operands);
+
+		_instructions.push_back(inst);
+		_definitions.push_back(static_cast<uint32_t>(_instructions.size()));
+		_scalar_types.push_back(scalar_type::none);
+
+		return result;
+	}
+	spv::Id find_or_add_scalar_constant(spv::Id type, scalar_type scalar, uint32_t value)
+	{
+		if (scalar == scalar_type::boolean)
+			value = value != 0;
+
+		const auto insert = _scalar_constants.emplace((static_cast<uint64_t>(type) << 32) | value, 0);
+		if (insert.second)
+		{
+			if (scalar == scalar_type::boolean)
+				insert.first->second = add_constant(value ? spv::OpConstantTrue : spv::OpConstantFalse, type, nullptr, 0);
+			else
+				insert.first->second = add_constant(spv::OpConstant, type, &value, 1);
+		}
+
+		return insert.first->second;
+	}
+
+	/// <summary>
+	/// Evaluates the instruction at the specified <paramref name="index"/> if all its operands are constant.
+	/// </summary>
+	/// <returns>ID of the value that can replace its result, or zero if it cannot be folded.</returns>
+	spv::Id fold(size_t index)
+	{
+		const instruction inst = _instructions[index];
+		const spv::Id result_type = _words[inst.offset + 1];
+		const uint32_t *const operands = _words.data() + inst.offset + inst.first_operand;
+		const uint32_t num_operands = inst.word_count - inst.first_operand;
+
+		switch (inst.op)
+		{
+		case spv::OpCompositeExtract:
+		{
+			spv::Id composite = operands[0];
+			for (uint32_t i = 1; i < num_operands; ++i)
+			{
+				const instruction *const composite_inst = find_definition(composite);
+				if (composite_inst == nullptr || composite_inst->op != spv::OpConstantComposite || operands[i] >= composite_inst->word_count - 3)
+					return 0;
+				composite = _words[composite_inst->offset + 3 + operands[i]];
+			}
+			return composite;
+		}
+		case spv::OpCompositeConstruct:
+		{
+			// Only vectors built from scalars and matrices built from vectors map directly to a constant composite
+			const instruction *const type_inst = find_definition(result_type);
+			if (type_inst == nullptr || (type_inst->op != spv::OpTypeVector && type_inst->op != spv::OpTypeMatrix) || _words[type_inst->offset + 3] != num_operands)
+				return 0;
+
+			for (uint32_t i = 0; i < num_operands; ++i)
+			{
+				const instruction *const constituent_inst = find_definition(operands[i]);
+				if (constituent_inst == nullptr || (constituent_inst->op != spv::OpConstant && constituent_inst->op != spv::OpConstantTrue && constituent_inst->op != spv::OpConstantFalse && constituent_inst->op != spv::OpConstantComposite))
+					return 0;
+			}
+
+			std::vector<uint32_t> key = make_composite_key(result_type, operands, num_operands);
+			if (const auto it = _composite_constants.find(key);
+				it != _composite_constants.end())
+				return it->second;
+
+			const spv::Id result = add_constant(spv::OpConstantComposite, result_type, key.data() + 1, num_operands);
+			_composite_constants.emplace(std::move(key), result);
+			return result;
+		}
+		case spv::OpSelect:
+		{
+			scalar_type condition_type; uint32_t condition;
+			if (!get_scalar_constant(operands[0], condition_type, condition) || condition_type != scalar_type::boolean)
+				return 0;
+			return condition ? operands[1] : operands[2];
+		}
+		default:
+			break;
+		}
+
+		const scalar_type type = _scalar_types[result_type];
+		if (type == scalar_type::none || num_operands < 1 || num_operands > 2)
+			return 0;
+
+		scalar_type a_type, b_type = scalar_type::none;
+		uint32_t a, b = 0;
+		if (!get_scalar_constant(operands[0], a_type, a) || (num_operands == 2 && !get_scalar_constant(operands[1], b_type, b)))
+			return 0;
+
+		const bool is_int = (a_type == scalar_type::sint || a_type == scalar_type::uint) && (num_operands == 1 || b_type == scalar_type::sint || b_type == scalar_type::uint);
+		const bool is_float = a_type == scalar_type::floating && (num_operands == 1 || b_type == scalar_type::floating);
+		const bool is_bool = a_type == scalar_type::boolean && (num_operands == 1 || b_type == scalar_type::boolean);
+
+		float af, bf;
+		std::memcpy(&af, &a, sizeof(af));
+		std::memcpy(&bf, &b, sizeof(bf));
+		const int32_t as = static_cast<int32_t>(a), bs = static_cast<int32_t>(b);
+
+		uint32_t value;
+		float value_float;
+		bool is_float_result = false;
+
+		switch (inst.op)
+		{
+		case spv::OpIAdd:
+			if (!is_int || num_operands != 2) return 0;
+			value = a + b;
+			break;
+		case spv::OpISub:
+			if (!is_int || num_operands != 2) return 0;
+			value = a - b;
+			break;
+		case spv::OpIMul:
+			if (!is_int || num_operands != 2) return 0;
+			value = a * b;
+			break;
+		case spv::OpSDiv:
+			if (!is_int || num_operands != 2 || b == 0 || (as == INT32_MIN && bs == -1)) return 0;
+			value = static_cast<uint32_t>(as / bs);
+			break;
+		case spv::OpSRem:
+			if (!is_int || num_operands != 2 || b == 0 || (as == INT32_MIN && bs == -1)) return 0;
+			value = static_cast<uint32_t>(as % bs);
+			break;
+		case spv::OpUDiv:
+			if (!is_int || num_operands != 2 || b == 0) return 0;
+			value = a / b;
+			break;
+		case spv::OpUMod:
+			if (!is_int || num_operands != 2 || b == 0) return 0;
+			value = a % b;
+			break;
+		case spv::OpSNegate:
+			if (!is_int || num_operands != 1) return 0;
+			value = 0u - a;
+			break;
+		case spv::OpNot:
+			if (!is_int || num_operands != 1) return 0;
+			value = ~a;
+			break;
+		case spv::OpBitwiseAnd:
+			if (!is_int || num_operands != 2) return 0;
+			value = a & b;
+			break;
+		case spv::OpBitwiseOr:
+			if (!is_int || num_operands != 2) return 0;
+			value = a | b;
+			break;
+		case spv::OpBitwiseXor:
+			if (!is_int || num_operands != 2) return 0;
+			value = a ^ b;
+			break;
+		case spv::OpShiftLeftLogical:
+			if (!is_int || num_operands != 2 || b >= 32) return 0;
+			value = a << b;
+			break;
+		case spv::OpShiftRightLogical:
+			if (!is_int || num_operands != 2 || b >= 32) return 0;
+			value = a >> b;
+			break;
+		case spv::OpShiftRightArithmetic:
+			if (!is_int || num_operands != 2 || b >= 32) return 0;
+			value = static_cast<uint32_t>(as >> b);
+			break;
+		case spv::OpIEqual:
+			if (!is_int || num_operands != 2) return 0;
+			value = a == b;
+			break;
+		case spv::OpINotEqual:
+			if (!is_int || num_operands != 2) return 0;
+			value = a != b;
+			break;
+		case spv::OpSLessThan:
+			if (!is_int || num_operands != 2) return 0;
+			value = as < bs;
+			break;
+		case spv::OpSLessThanEqual:
+			if (!is_int || num_operands != 2) return 0;
+			value = as <= bs;
+			break;
+		case spv::OpSGreaterThan:
+			if (!is_int || num_operands != 2) return 0;
+			value = as > bs;
+			break;
+		case spv::OpSGreaterThanEqual:
+			if (!is_int || num_operands != 2) return 0;
+			value = as >= bs;
+			break;
+		case spv::OpULessThan:
+			if (!is_int || num_operands != 2) return 0;
+			value = a < b;
+			break;
+		case spv::OpULessThanEqual:
+			if (!is_int || num_operands != 2) return 0;
+			value = a <= b;
+			break;
+		case spv::OpUGreaterThan:
+			if (!is_int || num_operands != 2) return 0;
+			value = a > b;
+			break;
+		case spv::OpUGreaterThanEqual:
+			if (!is_int || num_operands != 2) return 0;
+			value = a >= b;
+			break;
+		case spv::OpFAdd:
+			if (!is_float || num_operands != 2) return 0;
+			value_float = af + bf;
+			is_float_result = true;
+			break;
+		case spv::OpFSub:
+			if (!is_float || num_operands != 2) return 0;
+			value_float = af - bf;
+			is_float_result = true;
+			break;
+		case spv::OpFMul:
+			if (!is_float || num_operands != 2) return 0;
+			value_float = af * bf;
+			is_float_result = true;
+			break;
+		case spv::OpFDiv:
+			if (!is_float || num_operands != 2) return 0;
+			value_float = af / bf;
+			is_float_result = true;
+			break;
+		case spv::OpFNegate:
+			if (!is_float || num_operands != 1) return 0;
+			value = a ^ 0x80000000;
+			break;
+		case spv::OpFOrdEqual:
+			if (!is_float || num_operands != 2) return 0;
+			value = af == bf;
+			break;
+		case spv::OpFOrdNotEqual:
+			if (!is_float || num_operands != 2 || af != af || bf != bf) return 0;
+			value = af != bf;
+			break;
+		case spv::OpFOrdLessThan:
+			if (!is_float || num_operands != 2) return 0;
+			value = af < bf;
+			break;
+		case spv::OpFOrdLessThanEqual:
+			if (!is_float || num_operands != 2) return 0;
+			value = af <= bf;
+			break;
+		case spv::OpFOrdGreaterThan:
+			if (!is_float || num_operands != 2) return 0;
+			value = af > bf;
+			break;
+		case spv::OpFOrdGreaterThanEqual:
+			if (!is_float || num_operands != 2) return 0;
+			value = af >= bf;
+			break;
+		case spv::OpConvertSToF:
+			if (!is_int || num_operands != 1) return 0;
+			value_float = static_cast<float>(as);
+			is_float_result = true;
+			break;
+		case spv::OpConvertUToF:
+			if (!is_int || num_operands != 1) return 0;
+			value_float = static_cast<float>(a);
+			is_float_result = true;
+			break;
+		case spv::OpConvertFToS:
+			if (!is_float || num_operands != 1 || !(af > -2147483649.0f && af < 2147483648.0f)) return 0;
+			value = static_cast<uint32_t>(static_cast<int32_t>(af));
+			break;
+		case spv::OpConvertFToU:
+			if (!is_float || num_operands != 1 || !(af > -1.0f && af < 4294967296.0f)) return 0;
+			value = static_cast<uint32_t>(af);
+			break;
+		case spv::OpBitcast:
+			if (num_operands != 1 || a_type == scalar_type::boolean || type == scalar_type::boolean) return 0;
+			value = a;
+			break;
+		case spv::OpLogicalNot:
+			if (!is_bool || num_operands != 1) return 0;
+			value = !a;
+			break;
+		case spv::OpLogicalAnd:
+			if (!is_bool || num_operands != 2) return 0;
+			value = a && b;
+			break;
+		case spv::OpLogicalOr:
+			if (!is_bool || num_operands != 2) return 0;
+			value = a || b;
+			break;
+		case spv::OpLogicalEqual:
+			if (!is_bool || num_operands != 2) return 0;
+			value = a == b;
+			break;
+		case spv::OpLogicalNotEqual:
+			if (!is_bool || num_operands != 2) return 0;
+			value = a != b;
+			break;
+		default:
+			return 0;
+		}
+
+		if (is_float_result)
+		{
+			// Leave operations producing infinity or NaN to the driver, to not have to reason about how the target hardware handles them
+			if (type != scalar_type::floating || !std::isfinite(value_float))
+				return 0;
+			std::memcpy(&value, &value_float, sizeof(value));
+		}
+
+		return find_or_add_scalar_constant(result_type, type, value);
+	}
+
+	std::vector<uint32_t> &_words;
+	std::vector<instruction> _instructions;
+	size_t _first_function = 0;
+	size_t _num_module_instructions = 0;
+	spv::Id _bound = 0;
+	std::vector<uint32_t> _definitions; // Maps result IDs to one plus the index of the instruction defining them
+	std::vector<scalar_type> _scalar_types;
+	std::unordered_map<uint64_t, spv::Id> _scalar_constants; // Maps result type and value to an existing constant
+	std::map<std::vector<uint32_t>, spv::Id> _composite_constants; // Maps result type and constituents to an existing constant composite
+	std::unordered_map<spv::Id, spv::StorageClass> _variable_storage;
+};
+
+void reshadefx::optimize_spirv(std::string &spirv, int optimization_level)
+{
+	if (optimization_level < 0 || spirv.size() % sizeof(uint32_t) != 0)
+		return;
+
+	std::vector<uint32_t> words(spirv.size() / sizeof(uint32_t));
+	std::memcpy(words.data(), spirv.data(), spirv.size());
+
+	spirv_optimizer optimizer(words);
+	if (!optimizer.parse())
+		return;
+
+	if (optimization_level >= 2)
+		optimizer.forward_and_fold_values();
+
+	optimizer.eliminate_dead_code();
+
+	spirv.assign(reinterpret_cast<const char *>(words.data()), words.size() * sizeof(uint32_t));
+}
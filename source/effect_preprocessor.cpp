@@ -5,10 +5,11 @@
 
 #include "effect_lexer.hpp"
 #include "effect_preprocessor.hpp"
+#include <mutex>
 #include <limits>
 #include <cstdio> // fclose, fopen, fread, fseek
 #include <cassert>
-#include <algorithm> // std::find_if
+#include <algorithm> // std::count, std::find_if, std::min
 
 #ifndef _WIN32
 	// On Linux systems the native path encoding is UTF-8 already, so no conversion necessary
@@ -99,6 +100,138 @@ static bool read_file(const std::filesystem::path &path, std::string &file_data)
 	return true;
 }
 
+struct reshadefx::preprocessor::parsed_file
+{
+	std::shared_ptr<const std::string> data;
+	std::vector<token> tokens;
+	// Name of the macro guarding the entire file contents via '#ifndef', or empty if there is none
+	std::string include_guard;
+};
+
+void reshadefx::preprocessor::token_list::append(const token &tok, std::string_view raw_data)
+{
+	// Location is not copied, since it is only assigned once the list is pushed as a new input level
+	token &new_token = tokens.emplace_back();
+	new_token.id = tok.id;
+	new_token.offset = data.size();
+	new_token.length = raw_data.size();
+	new_token.literal_as_uint = tok.literal_as_uint;
+	new_token.literal_as_string = tok.literal_as_string;
+	data += raw_data;
+}
+void reshadefx::preprocessor::token_list::append(const token_list &list)
+{
+	const size_t offset = data.size();
+	data += list.data;
+	for (const token &tok : list.tokens)
+		tokens.emplace_back(tok).offset += offset;
+}
+
+static std::string find_include_guard(const std::vector<reshadefx::token> &tokens)
+{
+	using reshadefx::tokenid;
+
+	size_t i = 0;
+	const auto skip_whitespace = [&tokens, &i]() {
+		while (i < tokens.size() && (tokens[i] == tokenid::space || tokens[i] == tokenid::end_of_line))
+			++i;
+	};
+
+	// File has to start with an '#ifndef' directive (only preceded by whitespace and comments) ...
+	skip_whitespace();
+	if (i >= tokens.size() || tokens[i] != tokenid::hash_ifndef)
+		return std::string();
+	while (++i < tokens.size() && tokens[i] == tokenid::space)
+		continue;
+	if (i >= tokens.size() || tokens[i] != tokenid::identifier)
+		return std::string();
+
+	const std::string &include_guard = tokens[i].literal_as_string;
+
+	// ... without an '#else' or '#elif' branch ...
+	for (size_t depth = 1; ++i < tokens.size();)
+	{
+		if (tokens[i] == tokenid::hash_if || tokens[i] == tokenid::hash_ifdef || tokens[i] == tokenid::hash_ifndef)
+			++depth;
+		else if ((tokens[i] == tokenid::hash_else || tokens[i] == tokenid::hash_elif) && depth == 1)
+			return std::string();
+		else if (tokens[i] == tokenid::hash_endif && --depth == 0)
+			break;
+	}
+
+	// ... and the matching '#endif' has to be the last directive in the file
+	while (++i < tokens.size() && tokens[i] != tokenid::end_of_line)
+		continue;
+	skip_whitespace();
+	if (i >= tokens.size() || tokens[i] != tokenid::end_of_file)
+		return std::string();
+
+	return include_guard;
+}
+
+std::shared_ptr<const reshadefx::preprocessor::parsed_file> reshadefx::preprocessor::read_file_shared(const std::filesystem::path &path)
+{
+	struct shared_file
+	{
+		std::filesystem::file_time_type last_write_time;
+		std::weak_ptr<const parsed_file> file;
+	};
+
+	static std::mutex s_shared_file_cache_mutex;
+	static std::unordered_map<std::string, shared_file> s_shared_file_cache;
+
+	// Multiple preprocessor instances (e.g. on different threads) often include the same files, so share their tokenized contents while any instance is still using them
+	// Entries only hold a weak reference, so that the memory is released again once all instances are done
+	std::error_code ec;
+	const std::filesystem::file_time_type last_write_time = std::filesystem::last_write_time(path, ec);
+	const std::string path_string = path.u8string();
+
+	if (!ec)
+	{
+		const std::unique_lock<std::mutex> lock(s_shared_file_cache_mutex);
+
+		if (const auto it = s_shared_file_cache.find(path_string);
+			it != s_shared_file_cache.end() && it->second.last_write_time == last_write_time)
+		{
+			if (std::shared_ptr<const parsed_file> file = it->second.file.lock())
+				return file;
+		}
+	}
+
+	std::string file_data;
+	if (!read_file(path, file_data))
+		return nullptr;
+
+	const auto file = std::make_shared<parsed_file>();
+	file->data = std::make_shared<const std::string>(std::move(file_data));
+
+	// Tokenize the entire file up front with the same settings 'push' uses, so that the tokens can be replayed by every preprocessor instance including this file
+	// Tokens contain the file path as source location, which is why the path string is used as name for the pushed input level too
+	lexer lexer(
+		file->data,
+		true  /* ignore_comments */,
+		false /* ignore_whitespace */,
+		false /* ignore_pp_directives */,
+		false /* ignore_line_directives */,
+		true  /* ignore_keywords */,
+		false /* escape_string_literals */,
+		location(path_string, 1));
+	do
+		file->tokens.push_back(lexer.lex());
+	while (file->tokens.back() != tokenid::end_of_file);
+
+	file->include_guard = find_include_guard(file->tokens);
+
+	if (!ec)
+	{
+		const std::unique_lock<std::mutex> lock(s_shared_file_cache_mutex);
+
+		s_shared_file_cache[path_string] = { last_write_time, file };
+	}
+
+	return file;
+}
+
 template <char ESCAPE_CHAR = '\\'>
 static std::string escape_string(std::string s)
 {
@@ -122,9 +255,12 @@ void reshadefx::preprocessor::add_include_path(const std::filesystem::path &path
 bool reshadefx::preprocessor::add_macro_definition(const std::string &name, const macro &definition)
 {
 	assert(!name.empty());
-	const auto insert = _macros.emplace(name, definition);
+	const auto insert = _macros.emplace(name, tokenized_macro { definition });
 	if (insert.second)
+	{
+		tokenize_replacement_list(definition.replacement_list, insert.first->second.replacement_tokens);
 		return true;
+	}
 	// Allow redefinition of identical macros
 	const macro &existing_definition = insert.first->second;
 	return
@@ -137,11 +273,17 @@ bool reshadefx::preprocessor::add_macro_definition(const std::string &name, cons
 
 bool reshadefx::preprocessor::append_file(const std::filesystem::path &path)
 {
-	std::string source_code;
-	if (!read_file(path, source_code))
+	const std::shared_ptr<const parsed_file> source_code = read_file_shared(path);
+	if (source_code == nullptr)
 		return false;
 
-	return append_string(std::move(source_code), path);
+	// Only consider new errors added below for the success of this call
+	const size_t errors_offset = _errors.length();
+
+	push(source_code, path.u8string());
+	parse();
+
+	return _errors.find(": preprocessor error: ", errors_offset) == std::string::npos;
 }
 bool reshadefx::preprocessor::append_string(std::string source_code, const std::filesystem::path &path)
 {
@@ -165,7 +307,7 @@ std::vector<std::filesystem::path> reshadefx::preprocessor::included_files() con
 {
 	std::vector<std::filesystem::path> files;
 	files.reserve(_file_cache.size());
-	for (const std::pair<std::string, std::string> &cache_entry : _file_cache)
+	for (const std::pair<const std::string, std::shared_ptr<const parsed_file>> &cache_entry : _file_cache)
 		files.push_back(std::filesystem::u8path(cache_entry.first));
 	return files;
 }
@@ -200,16 +342,29 @@ void reshadefx::preprocessor::warning(const location &location, const std::strin
 	_errors += '\n';
 }
 
-void reshadefx::preprocessor::push(std::string input, const std::string &name)
+std::string_view reshadefx::preprocessor::input_level::input_string() const
+{
+	if (file != nullptr)
+		return *file->data;
+	if (lexer != nullptr)
+		return lexer->input_string();
+	return tokens.data;
+}
+
+reshadefx::location reshadefx::preprocessor::push_location(const std::string &name) const
 {
-	location start_location = !name.empty() ?
+	return !name.empty() ?
 		// Start at the beginning of the file when pushing a new file
 		location(name, 1) :
 		// Start with last known token location when pushing an unnamed string
 		_token.location;
+}
 
-	input_level level = { name };
-	level.lexer.reset(new lexer(
+void reshadefx::preprocessor::push(std::string input, const std::string &name)
+{
+	const location start_location = push_location(name);
+
+	push(std::make_unique<lexer>(
 		std::move(input),
 		true  /* ignore_comments */,
 		false /* ignore_whitespace */,
@@ -217,20 +372,127 @@ void reshadefx::preprocessor::push(std::string input, const std::string &name)
 		false /* ignore_line_directives */,
 		true  /* ignore_keywords */,
 		false /* escape_string_literals */,
-		start_location));
+		start_location), name, start_location);
+}
+void reshadefx::preprocessor::push(std::shared_ptr<const parsed_file> file, const std::string &name)
+{
+	assert(!name.empty() && !file->tokens.empty());
+
+	input_level level = { name };
+	level.file = std::move(file);
+	level.next_token.id = tokenid::unknown;
+	level.next_token.location = push_location(name); // This is used in 'consume' to initialize the output location
+
+	push_level(std::move(level));
+}
+void reshadefx::preprocessor::push(std::unique_ptr<lexer> lexer, const std::string &name, const location &start_location)
+{
+	input_level level = { name };
+	level.lexer = std::move(lexer);
 	level.next_token.id = tokenid::unknown;
 	level.next_token.location = start_location; // This is used in 'consume' to initialize the output location
 
-	// Inherit hidden macros from parent
-	if (!_input_stack.empty())
-		level.hidden_macros = _input_stack.back().hidden_macros;
+	push_level(std::move(level));
+}
+void reshadefx::preprocessor::push(token_list &&tokens, std::string hidden_macro)
+{
+	const location start_location = push_location(std::string());
+
+	// Assign locations and skip whitespace the same way the lexer would if the raw data of all tokens was lexed as a whole
+	location location = start_location;
+	size_t num_tokens = 0;
+	for (size_t i = 0; i < tokens.tokens.size(); ++i)
+	{
+		token &tok = tokens.tokens[i];
+
+		if (tok == tokenid::space)
+		{
+			size_t space_end = i;
+			size_t space_length = 0;
+			for (; space_end < tokens.tokens.size() && tokens.tokens[space_end] == tokenid::space; ++space_end)
+				space_length += tokens.tokens[space_end].length;
+
+			// The lexer does not report whitespace at the beginning of a line or right before a line feed
+			if (location.column <= 1 || (space_end < tokens.tokens.size() && tokens.tokens[space_end] == tokenid::end_of_line))
+			{
+				location.column += static_cast<uint32_t>(space_length);
+				i = space_end - 1;
+				continue;
+			}
+		}
+
+		// The source is only stored once in the last token (end of file), since it is the same for all tokens
+		tok.location.line = location.line;
+		tok.location.column = location.column;
 
+		if (tok == tokenid::end_of_line)
+		{
+			location.line++;
+			location.column = 1;
+		}
+		else
+		{
+			// String literals may continue on to the next line after an escape character
+			if (tok == tokenid::string_literal)
+				location.line += static_cast<uint32_t>(std::count(tokens.data.begin() + tok.offset, tokens.data.begin() + tok.offset + tok.length, '\n'));
+			location.column += static_cast<uint32_t>(tok.length);
+		}
+
+		if (num_tokens != i)
+			tokens.tokens[num_tokens] = std::move(tok);
+		num_tokens++;
+	}
+
+	tokens.tokens.erase(tokens.tokens.begin() + num_tokens, tokens.tokens.end());
+
+	token &end_of_file_token = tokens.tokens.emplace_back();
+	end_of_file_token.id = tokenid::end_of_file;
+	end_of_file_token.location = std::move(location);
+	end_of_file_token.offset = tokens.data.size();
+	end_of_file_token.length = 0;
+	end_of_file_token.literal_as_uint = 0;
+
+	input_level level = {};
+	level.tokens = std::move(tokens);
+	level.next_token.id = tokenid::unknown;
+	level.next_token.location = start_location; // This is used in 'consume' to initialize the output location
+	level.hidden_macro = std::move(hidden_macro);
+
+	push_level(std::move(level));
+}
+void reshadefx::preprocessor::push_level(input_level &&level)
+{
 	_input_stack.push_back(std::move(level));
 	_next_input_index = _input_stack.size() - 1;
 
 	// Advance into the input stack to update next token
 	consume();
 }
+void reshadefx::preprocessor::pop_level()
+{
+	release_token_list(std::move(_input_stack.back().tokens));
+	_input_stack.pop_back();
+}
+
+reshadefx::preprocessor::token_list reshadefx::preprocessor::acquire_token_list()
+{
+	if (_unused_token_lists.empty())
+		return token_list();
+
+	token_list list = std::move(_unused_token_lists.back());
+	_unused_token_lists.pop_back();
+	return list;
+}
+void reshadefx::preprocessor::release_token_list(token_list &&list)
+{
+	if (list.tokens.capacity() == 0)
+		return;
+
+	// Clearing keeps the allocated memory around, so that it can be reused for the next macro expansion
+	list.data.clear();
+	list.tokens.clear();
+	_unused_token_lists.push_back(std::move(list));
+}
 
 bool reshadefx::preprocessor::peek(tokenid tokid) const
 {
@@ -252,7 +514,7 @@ void reshadefx::preprocessor::consume()
 
 	// Clear out input stack, now that the current token is overwritten
 	while (_input_stack.size() > (_current_input_index + 1))
-		_input_stack.pop_back();
+		pop_level();
 
 	// Update location information after switching input levels
 	input_level &input = _input_stack[_current_input_index];
@@ -264,12 +526,21 @@ void reshadefx::preprocessor::consume()
 		_output_location.source = input.name;
 	}
 
-	// Set current token
-	_token = std::move(input.next_token);
-	_current_token_raw_data = input.lexer->input_string().substr(_token.offset, _token.length);
+	// Set current token (swap instead of move, so that the memory of the previous token can be reused for the next one)
+	std::swap(_token, input.next_token);
+	_current_token_raw_data = input.input_string().substr(_token.offset, _token.length);
 
 	// Get the next token
-	input.next_token = input.lexer->lex();
+	if (input.file != nullptr)
+		// Keep returning the last token (end of file) once the end was reached, same as the lexer does
+		input.next_token = input.file->tokens[std::min(input.next_token_index++, input.file->tokens.size() - 1)];
+	else if (input.lexer != nullptr)
+		input.next_token = input.lexer->lex();
+	else
+	{
+		input.next_token = input.tokens.tokens[std::min(input.next_token_index++, input.tokens.tokens.size() - 1)];
+		input.next_token.location.source = input.tokens.tokens.back().location.source;
+	}
 
 	// Verify string literals (since the lexer cannot throw errors itself)
 	if (_token == tokenid::string_literal && _current_token_raw_data.back() != '\"')
@@ -286,7 +557,7 @@ void reshadefx::preprocessor::consume()
 		if (_next_input_index == 0)
 		{
 			// End of input has been reached, so cannot pop further and this is the last token
-			_input_stack.pop_back();
+			pop_level();
 			return;
 		}
 		else
@@ -337,7 +608,7 @@ bool reshadefx::preprocessor::expect(tokenid tokid)
 		}
 		else
 		{
-			const std::string token_string = _input_stack[_next_input_index].lexer->input_string().substr(actual_token.offset, actual_token.length);
+			const std::string token_string(_input_stack[_next_input_index].input_string().substr(actual_token.offset, actual_token.length));
 			error(actual_token.location, "syntax error: unexpected token '" + token_string + '\'');
 		}
 
@@ -700,7 +971,7 @@ void reshadefx::preprocessor::parse_pragma()
 		if (const auto file_it = _file_cache.find(_output_location.source);
 			file_it != _file_cache.end())
 		{
-			file_it->second.clear();
+			file_it->second.reset();
 		}
 		return;
 	}
@@ -748,7 +1019,7 @@ void reshadefx::preprocessor::parse_include()
 			}) != _input_stack.end())
 		return error(_token.location, "recursive #include");
 
-	std::string input;
+	std::shared_ptr<const parsed_file> input;
 
 	if (const auto file_it = _file_cache.find(file_path_string);
 		file_it != _file_cache.end())
@@ -757,7 +1028,8 @@ void reshadefx::preprocessor::parse_include()
 	}
 	else
 	{
-		if (!read_file(file_path, input))
+		input = read_file_shared(file_path);
+		if (input == nullptr)
 			return error(keyword_location, "could not open included file '" + file_name.u8string() + '\'');
 
 		_file_cache.emplace(file_path_string, input);
@@ -767,11 +1039,24 @@ void reshadefx::preprocessor::parse_include()
 	if (!expect(tokenid::end_of_line))
 		consume_until(tokenid::end_of_line);
 
+	// Skip file entirely if it is guarded by a macro that is already defined, since its contents would be skipped anyway
+	if (input != nullptr && !input->include_guard.empty() && is_defined(input->include_guard))
+	{
+		// Keep track of used macros the same way evaluating the '#ifndef' directive would
+		if (const auto macro_it = _macros.find(input->include_guard);
+			macro_it == _macros.end() || macro_it->second.is_predefined)
+			_used_macros.emplace(input->include_guard);
+		return;
+	}
+
 	// Clear out input stack before pushing include, so that hidden macros do not bleed into the include
 	while (_input_stack.size() > (_next_input_index + 1))
-		_input_stack.pop_back();
+		pop_level();
 
-	push(std::move(input), file_path_string);
+	if (input != nullptr)
+		push(std::move(input), file_path_string);
+	else
+		push(std::string(), file_path_string);
 }
 
 bool reshadefx::preprocessor::evaluate_expression()
@@ -1150,27 +1435,25 @@ bool reshadefx::preprocessor::evaluate_identifier_as_macro()
 	if (macro_it == _macros.end())
 		return false;
 
-	if (!_input_stack.empty())
-	{
-		const std::unordered_set<std::string> &hidden_macros = _input_stack[_current_input_index].hidden_macros;
-		if (hidden_macros.find(_token.literal_as_string) != hidden_macros.end())
-			return false;
-	}
+	if (is_hidden(_token.literal_as_string))
+		return false;
 
 	const location macro_location = _token.location;
 	if (_recursion_count++ >= 256)
 		return error(macro_location, "macro recursion too high"), false;
 
-	std::vector<std::string> arguments;
+	std::vector<token_list> arguments;
 	if (macro_it->second.is_function_like)
 	{
 		if (!accept(tokenid::parenthesis_open))
 			return false; // Function like macro used without arguments, handle that like a normal identifier instead
 
+		arguments.reserve(macro_it->second.parameters.size());
+
 		while (true)
 		{
 			int parentheses_level = 0;
-			std::string argument;
+			token_list argument = acquire_token_list();
 
 			// Ignore whitespace preceding the argument
 			accept(tokenid::space);
@@ -1195,14 +1478,20 @@ bool reshadefx::preprocessor::evaluate_identifier_as_macro()
 
 				// Collapse all whitespace down to a single space
 				if (_token == tokenid::space)
-					argument += ' ';
+					argument.append(_token, " ");
+				// The raw data of directive tokens does not include the '#', so turn them back into normal tokens (the same way directives inside a macro invocation are ignored)
+				else if (_token >= tokenid::hash_def && _token <= tokenid::hash_unknown)
+					tokenize(_current_token_raw_data, argument);
 				else
-					argument += _current_token_raw_data;
+					argument.append(_token, _current_token_raw_data);
 			}
 
 			// Trim whitespace following the argument
-			if (argument.size() && argument.back() == ' ')
-				argument.pop_back();
+			if (!argument.tokens.empty() && argument.tokens.back() == tokenid::space)
+			{
+				argument.data.pop_back();
+				argument.tokens.pop_back();
+			}
 
 			arguments.push_back(std::move(argument));
 
@@ -1213,6 +1502,9 @@ bool reshadefx::preprocessor::evaluate_identifier_as_macro()
 
 	expand_macro(macro_it->first, macro_it->second, arguments);
 
+	for (token_list &argument : arguments)
+		release_token_list(std::move(argument));
+
 	return true;
 }
 
@@ -1227,8 +1519,16 @@ bool reshadefx::preprocessor::is_defined(const std::string &name) const
 		name == "__FILE_NAME__" ||
 		name == "__FILE_NAME_HASH__";
 }
+bool reshadefx::preprocessor::is_hidden(const std::string &name) const
+{
+	// A macro is hidden in the level containing its expansion and all levels pushed on top of that
+	for (size_t i = 0; i <= _current_input_index && i < _input_stack.size(); ++i)
+		if (_input_stack[i].hidden_macro == name)
+			return true;
+	return false;
+}
 
-void reshadefx::preprocessor::expand_macro(const std::string &name, const macro &definition, const std::vector<std::string> &arguments)
+void reshadefx::preprocessor::expand_macro(const std::string &name, const tokenized_macro &definition, const std::vector<token_list> &arguments)
 {
 	if (definition.replacement_list.empty())
 		return;
@@ -1239,30 +1539,64 @@ void reshadefx::preprocessor::expand_macro(const std::string &name, const macro
 	if (arguments.size() > definition.parameters.size() && !definition.is_variadic)
 		return warning(_token.location, "too many arguments for function-like macro invocation '" + name + "'");
 
-	std::string input;
-	input.reserve(definition.replacement_list.size());
+	token_list expansion = acquire_token_list();
+	expansion.data.reserve(definition.replacement_list.size());
+	expansion.tokens.reserve(definition.replacement_tokens.tokens.size() + 1);
 
-	for (size_t offset = 0; offset < definition.replacement_list.size(); ++offset)
+	bool concatenate_next = false;
+	const auto append = [&expansion, &concatenate_next](const token &tok, std::string_view raw_data) {
+		if (!concatenate_next || expansion.tokens.empty())
+		{
+			expansion.append(tok, raw_data);
+		}
+		else
+		{
+			// Concatenated tokens are lexed again as a whole, since they may form a different token (e.g. an identifier from two parts)
+			std::string concatenated_data(expansion.raw_data(expansion.tokens.size() - 1));
+			concatenated_data += raw_data;
+
+			expansion.data.resize(expansion.tokens.back().offset);
+			expansion.tokens.pop_back();
+
+			tokenize(concatenated_data, expansion);
+		}
+		concatenate_next = false;
+	};
+	const auto append_tokenized = [&append](std::string_view input) {
+		token_list list;
+		tokenize(input, list);
+		for (size_t i = 0; i < list.tokens.size(); ++i)
+			append(list.tokens[i], list.raw_data(i));
+	};
+
+	const token_list &replacement = definition.replacement_tokens;
+	for (size_t i = 0; i < replacement.tokens.size(); ++i)
 	{
-		if (definition.replacement_list[offset] != macro_replacement_start)
+		const std::string_view raw_data = replacement.raw_data(i);
+		if (replacement.tokens[i] != tokenid::unknown || raw_data[0] != macro_replacement_start)
 		{
-			input += definition.replacement_list[offset];
+			append(replacement.tokens[i], raw_data);
 			continue;
 		}
 
 		// This is a special replacement sequence
-		const char type = definition.replacement_list[++offset];
-		const char index = definition.replacement_list[++offset];
+		const char type = raw_data[1];
+		const char index = raw_data[2];
 		if (static_cast<size_t>(index) >= arguments.size())
 		{
 			if (definition.is_variadic)
 			{
 				// The concatenation operator has a special meaning when placed between a comma and a variable argument, deleting the preceding comma
-				if (type == macro_replacement_concat && input.back() == ',')
-					input.pop_back();
+				if (type == macro_replacement_concat && !expansion.tokens.empty() && expansion.tokens.back() == tokenid::comma)
+				{
+					expansion.data.resize(expansion.tokens.back().offset);
+					expansion.tokens.pop_back();
+				}
 				if (type == macro_replacement_stringize)
-					input += "\"\"";
+					append_tokenized("\"\"");
 			}
+			if (type == macro_replacement_concat)
+				concatenate_next = true;
 			continue;
 		}
 
@@ -1270,7 +1604,19 @@ void reshadefx::preprocessor::expand_macro(const std::string &name, const macro
 		{
 		case macro_replacement_argument:
 			// Argument prescan
-			push(arguments[index] + static_cast<char>(macro_replacement_argument));
+			{
+				token_list argument = acquire_token_list();
+				argument.data.reserve(arguments[index].data.size() + 1);
+				argument.tokens.reserve(arguments[index].tokens.size() + 2); // Reserve space for the end marker and end of file tokens
+				argument.append(arguments[index]);
+
+				token end_marker;
+				end_marker.id = tokenid::unknown;
+				end_marker.literal_as_uint = 0;
+				const char end_marker_data = macro_replacement_argument;
+				argument.append(end_marker, std::string_view(&end_marker_data, 1));
+				push(std::move(argument));
+			}
 			while (true)
 			{
 				// Consume all tokens of the argument (until the end marker is reached)
@@ -1281,24 +1627,25 @@ void reshadefx::preprocessor::expand_macro(const std::string &name, const macro
 				if (_token == tokenid::identifier && evaluate_identifier_as_macro())
 					continue;
 
-				input += _current_token_raw_data;
+				append(_token, _current_token_raw_data);
 			}
 			assert(_current_token_raw_data[0] == macro_replacement_argument);
 			break;
 		case macro_replacement_concat:
-			input += arguments[index];
+			concatenate_next = true;
+			for (size_t k = 0; k < arguments[index].tokens.size(); ++k)
+				append(arguments[index].tokens[k], arguments[index].raw_data(k));
+			concatenate_next = true;
 			break;
 		case macro_replacement_stringize:
 			// Adds backslashes to escape quotes
-			input += escape_string<'\"'>(arguments[index]);
+			append_tokenized(escape_string<'\"'>(arguments[index].data));
 			break;
 		}
 	}
 
-	push(std::move(input));
-
 	// Avoid expanding macros again that are referencing themselves
-	_input_stack[_current_input_index].hidden_macros.insert(name);
+	push(std::move(expansion), name);
 }
 
 void reshadefx::preprocessor::create_macro_replacement_list(macro &definition)
@@ -1387,3 +1734,39 @@ void reshadefx::preprocessor::create_macro_replacement_list(macro &definition)
 	if (definition.replacement_list.size() && definition.replacement_list.back() == ' ')
 		definition.replacement_list.pop_back();
 }
+
+void reshadefx::preprocessor::tokenize(std::string_view input, token_list &list)
+{
+	// Start past the first column, so that the lexer does not consider the input to be at the beginning of a line (which would skip leading whitespace)
+	lexer lexer(
+		std::string(input),
+		true  /* ignore_comments */,
+		false /* ignore_whitespace */,
+		false /* ignore_pp_directives */,
+		false /* ignore_line_directives */,
+		true  /* ignore_keywords */,
+		false /* escape_string_literals */,
+		location(1, 2));
+
+	for (token tok = lexer.lex(); tok != tokenid::end_of_file; tok = lexer.lex())
+		list.append(tok, lexer.input_string().substr(tok.offset, tok.length));
+}
+void reshadefx::preprocessor::tokenize_replacement_list(const std::string &replacement_list, token_list &list)
+{
+	for (size_t offset = 0, next_offset; offset < replacement_list.size(); offset = next_offset)
+	{
+		next_offset = std::min(replacement_list.find(static_cast<char>(macro_replacement_start), offset), replacement_list.size());
+		if (next_offset != offset)
+			tokenize(std::string_view(replacement_list).substr(offset, next_offset - offset), list);
+
+		if (next_offset < replacement_list.size())
+		{
+			// Keep each special replacement sequence as a single token, which is substituted during expansion
+			token replacement_token;
+			replacement_token.id = tokenid::unknown;
+			replacement_token.literal_as_uint = 0;
+			list.append(replacement_token, std::string_view(replacement_list).substr(next_offset, 3));
+			next_offset += 3;
+		}
+	}
+}
@@ -6,7 +6,8 @@
 #pragma once
 
 #include "effect_token.hpp"
-#include <memory> // std::unique_ptr
+#include <memory> // std::shared_ptr, std::unique_ptr
+#include <string_view>
 #include <filesystem>
 #include <unordered_map>
 #include <unordered_set>
@@ -90,6 +91,24 @@ namespace reshadefx
 		std::vector<std::pair<std::string, std::string>> used_macro_definitions() const;
 
 	private:
+		struct parsed_file;
+
+		struct token_list
+		{
+			// Raw input data of all tokens, which the offset and length of each token refer to
+			std::string data;
+			std::vector<token> tokens;
+
+			void append(const token &tok, std::string_view raw_data);
+			void append(const token_list &list);
+			std::string_view raw_data(size_t index) const { return std::string_view(data).substr(tokens[index].offset, tokens[index].length); }
+		};
+		struct tokenized_macro : macro
+		{
+			// Replacement list split into tokens once when the macro is defined, so that expanding it does not need to run the lexer again
+			token_list replacement_tokens;
+		};
+
 		struct if_level
 		{
 			bool value;
@@ -101,14 +120,33 @@ namespace reshadefx
 		{
 			std::string name;
 			std::unique_ptr<class lexer> lexer;
+			// Pre-tokenized file contents, which are replayed instead of running a lexer
+			std::shared_ptr<const parsed_file> file;
+			// Tokens of a macro expansion, which are replayed the same way as pre-tokenized file contents
+			token_list tokens;
+			size_t next_token_index = 0;
 			token next_token;
-			std::unordered_set<std::string> hidden_macros;
+			// Macro this level is the expansion of, which may not be expanded again in it or any level above it
+			std::string hidden_macro;
+
+			std::string_view input_string() const;
 		};
 
 		void error(const location &location, const std::string &message);
 		void warning(const location &location, const std::string &message);
 
 		void push(std::string input, const std::string &name = std::string());
+		void push(std::shared_ptr<const parsed_file> file, const std::string &name);
+		void push(std::unique_ptr<class lexer> lexer, const std::string &name, const location &start_location);
+		void push(token_list &&tokens, std::string hidden_macro = std::string());
+		location push_location(const std::string &name) const;
+		void push_level(input_level &&level);
+		void pop_level();
+
+		token_list acquire_token_list();
+		void release_token_list(token_list &&list);
+
+		static std::shared_ptr<const parsed_file> read_file_shared(const std::filesystem::path &path);
 
 		bool peek(tokenid tokid) const;
 		void consume();
@@ -134,12 +172,18 @@ namespace reshadefx
 		bool evaluate_identifier_as_macro();
 
 		bool is_defined(const std::string &name) const;
-		void expand_macro(const std::string &name, const macro &definition, const std::vector<std::string> &arguments);
+		bool is_hidden(const std::string &name) const;
+		void expand_macro(const std::string &name, const tokenized_macro &definition, const std::vector<token_list> &arguments);
 		void create_macro_replacement_list(macro &definition);
 
+		static void tokenize(std::string_view input, token_list &list);
+		static void tokenize_replacement_list(const std::string &replacement_list, token_list &list);
+
 		std::string _output, _errors;
 
 		std::vector<input_level> _input_stack;
+		// Token lists that are no longer in use, which are reused for new macro expansions to avoid allocating memory for each of them again
+		std::vector<token_list> _unused_token_lists;
 		size_t _next_input_index = 0;
 		size_t _current_input_index = 0;
 		reshadefx::token _token;
@@ -148,11 +192,12 @@ namespace reshadefx
 
 		unsigned short _recursion_count = 0;
 		std::unordered_set<std::string> _used_macros;
-		std::unordered_map<std::string, macro> _macros;
+		std::unordered_map<std::string, tokenized_macro> _macros;
 
 		std::vector<if_level> _if_stack;
 
 		std::vector<std::filesystem::path> _include_paths;
-		std::unordered_map<std::string, std::string> _file_cache;
+		// Tokenized contents of all included files, which are shared with other preprocessor instances (or empty after '#pragma once')
+		std::unordered_map<std::string, std::shared_ptr<const parsed_file>> _file_cache;
 	};
 }
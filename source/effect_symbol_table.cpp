@@ -6,8 +6,10 @@
 #include "effect_symbol_table.hpp"
 #include <cassert>
 #include <malloc.h> // alloca
-#include <algorithm> // std::upper_bound, std::sort
+#include <algorithm> // std::lower_bound, std::upper_bound, std::sort, std::stable_sort
 #include <functional> // std::greater
+#include <string_view>
+#include <unordered_map>
 
 enum class intrinsic_id
 {
@@ -123,6 +125,22 @@ static const intrinsic s_intrinsics[] =
 	#include "effect_symbol_table_intrinsics.inl"
 };
 
+// Index of all intrinsic overloads by name, so that resolving a call does not have to walk the entire list above
+// Overloads are sorted by parameter count (keeping definition order otherwise), so that only those with a matching count need to be compared
+static const std::unordered_map<std::string_view, std::vector<const intrinsic *>> s_intrinsic_overloads = []() {
+	std::unordered_map<std::string_view, std::vector<const intrinsic *>> overloads;
+	for (const intrinsic &intrinsic : s_intrinsics)
+		overloads[intrinsic.name].push_back(&intrinsic);
+
+	for (std::pair<const std::string_view, std::vector<const intrinsic *>> &overload : overloads)
+		std::stable_sort(overload.second.begin(), overload.second.end(),
+			[](const intrinsic *lhs, const intrinsic *rhs) {
+				return lhs->parameter_list.size() < rhs->parameter_list.size();
+			});
+
+	return overloads;
+}();
+
 #undef void
 #undef bool
 #undef bool2
@@ -424,22 +442,27 @@ bool reshadefx::symbol_table::resolve_function_call(const std::string &name, con
 	}
 
 	// Try matching against intrinsic functions if no matching user-defined function was found up to this point
-	if (num_overloads == 0)
+	if (const auto overloads_it = num_overloads == 0 ? s_intrinsic_overloads.find(name) : s_intrinsic_overloads.end();
+		overloads_it != s_intrinsic_overloads.end())
 	{
-		for (const intrinsic &intrinsic : s_intrinsics)
+		const std::vector<const intrinsic *> &overloads = overloads_it->second;
+
+		for (auto it = std::lower_bound(overloads.begin(), overloads.end(), arguments.size(),
+				[](const intrinsic *overload, size_t num_arguments) {
+					return overload->parameter_list.size() < num_arguments;
+				}); it != overloads.end() && (*it)->parameter_list.size() == arguments.size(); ++it)
 		{
-			if (intrinsic.name != name || intrinsic.parameter_list.size() != arguments.size())
-				continue;
+			const intrinsic *const intrinsic = *it;
 
 			// A new possibly-matching intrinsic function was found, compare it against the current result
-			const int comparison = compare_functions(arguments, &intrinsic, result);
+			const int comparison = compare_functions(arguments, intrinsic, result);
 
 			if (comparison < 0) // The new function is a better match
 			{
 				out_data.op = symbol_type::intrinsic;
-				out_data.id = intrinsic.id;
-				out_data.type = intrinsic.return_type;
-				out_data.function = &intrinsic;
+				out_data.id = intrinsic->id;
+				out_data.type = intrinsic->return_type;
+				out_data.function = intrinsic;
 				result = out_data.function;
 				num_overloads = 1;
 			}
@@ -4,16 +4,192 @@
  */
 
 #include "ini_file.hpp"
+#include "thread_pool.hpp"
 #include <mutex>
 #include <shared_mutex>
+#include <unordered_set>
+#include <condition_variable>
 #include <cctype> // std::toupper
 #include <cassert>
-#include <algorithm> // std::min, std::sort, std::transform
+#include <utility> // std::exchange
+#include <algorithm> // std::find_if, std::lexicographical_compare, std::min, std::sort
 #include <utf8/core.h>
 
 static std::shared_mutex s_ini_cache_mutex;
 static std::unordered_map<std::filesystem::path::string_type, std::unique_ptr<reshade::ini_file>> s_ini_cache;
 
+using ini_sections = std::unordered_map<std::string, std::unordered_map<std::string, std::vector<std::string>>>;
+
+struct ini_save_request
+{
+	std::shared_ptr<const ini_sections> sections;
+	std::filesystem::file_time_type modified_at;
+};
+struct ini_saved_state
+{
+	std::filesystem::file_time_type modified_at;
+	uintmax_t size = 0;
+};
+
+static std::mutex s_ini_save_mutex;
+static std::condition_variable s_ini_save_finished;
+// Files waiting to be written in the background, only the most recent data is kept for each file
+static std::unordered_map<std::filesystem::path::string_type, ini_save_request> s_ini_save_queue;
+// Files that are currently being written, to prevent overlapping writes to the same file
+static std::unordered_set<std::filesystem::path::string_type> s_ini_save_in_progress;
+// Last write time and size of files that were written in the background, which are picked up by the next 'ini_file::load' so it does not parse them again
+static std::unordered_map<std::filesystem::path::string_type, ini_saved_state> s_ini_saved_states;
+static bool s_ini_save_scheduled = false;
+static bool s_ini_save_failed = false;
+
+static bool write_ini_file(const std::filesystem::path &path, const ini_sections &sections, std::filesystem::file_time_type modified_at, ini_saved_state &saved_state)
+{
+	std::error_code ec;
+	const std::filesystem::file_time_type disk_modified_at = std::filesystem::last_write_time(path, ec);
+	if (!ec && (disk_modified_at - modified_at) > std::chrono::seconds(2))
+		return false; // File exists and was modified on disk and therefore may have different data, so cannot save
+
+	// Sort sections and keys case-insensitively to generate consistent files, without copying their names
+	const auto compare_names = [](const auto *a, const auto *b) {
+		return std::lexicographical_compare(a->first.begin(), a->first.end(), b->first.begin(), b->first.end(),
+			[](char lhs, char rhs) { return std::toupper(static_cast<unsigned char>(lhs)) < std::toupper(static_cast<unsigned char>(rhs)); });
+	};
+
+	std::string data;
+	std::vector<const ini_sections::value_type *> sorted_sections;
+	std::vector<const ini_sections::mapped_type::value_type *> sorted_keys;
+
+	sorted_sections.reserve(sections.size());
+	for (const ini_sections::value_type &section : sections)
+		sorted_sections.push_back(&section);
+
+	std::sort(sorted_sections.begin(), sorted_sections.end(), compare_names);
+
+	for (const ini_sections::value_type *const section : sorted_sections)
+	{
+		if (const ini_sections::mapped_type &keys = section->second; !keys.empty())
+		{
+			sorted_keys.clear();
+			sorted_keys.reserve(keys.size());
+			for (const ini_sections::mapped_type::value_type &key : keys)
+				sorted_keys.push_back(&key);
+
+			std::sort(sorted_keys.begin(), sorted_keys.end(), compare_names);
+
+			// Empty section should have been sorted to the top, so do not need to append it before keys
+			if (!section->first.empty())
+				data += '[' + section->first + ']' + '\n';
+
+			for (const ini_sections::mapped_type::value_type *const key : sorted_keys)
+			{
+				data += key->first + '=';
+
+				if (const std::vector<std::string> &elements = key->second; !elements.empty())
+				{
+					std::string value;
+					for (const std::string &element : elements)
+					{
+						// Empty elements mess with escaped commas, so simply skip them
+						if (element.empty())
+							continue;
+
+						value.reserve(value.size() + element.size() + 1);
+						for (const char c : element)
+							value.append(c == ',' ? 2 : 1, c);
+						value += ','; // Separate multiple values with a comma
+					}
+
+					// Remove the last comma
+					if (!value.empty())
+					{
+						assert(value.back() == ',');
+						value.pop_back();
+					}
+
+					data += value;
+				}
+
+				data += '\n';
+			}
+
+			data += '\n';
+		}
+	}
+
+	// Write to a temporary file first and then replace the original with it, so that the file is never left partially written (e.g. when the application exits during the write)
+	std::filesystem::path temp_path = path;
+	temp_path += L".tmp";
+
+	FILE *const file = _wfsopen(temp_path.c_str(), L"w", SH_DENYWR);
+	if (file == nullptr)
+		return false;
+	const size_t file_size_written = fwrite(data.data(), 1, data.size(), file);
+	if (fclose(file) != 0 || file_size_written != data.size())
+	{
+		std::filesystem::remove(temp_path, ec);
+		return false;
+	}
+
+	std::filesystem::rename(temp_path, path, ec);
+	if (ec)
+	{
+		std::filesystem::remove(temp_path, ec);
+		return false;
+	}
+
+	// Stream was flushed to disk by closing it, so can update last write time now
+	// Size can differ from the data size due to line ending conversion in text mode, so query it too
+	const std::filesystem::directory_entry entry(path, ec);
+	saved_state.modified_at = entry.last_write_time(ec);
+	saved_state.size = entry.file_size(ec);
+
+	assert(!ec && saved_state.size > 0);
+
+	return true;
+}
+
+static void finish_ini_save(const std::filesystem::path::string_type &path, bool success, const ini_saved_state &saved_state)
+{
+	s_ini_save_in_progress.erase(path);
+
+	if (success)
+		s_ini_saved_states[path] = saved_state;
+
+	s_ini_save_finished.notify_all();
+}
+
+static void process_ini_save_queue()
+{
+	std::unique_lock<std::mutex> lock(s_ini_save_mutex);
+
+	while (true)
+	{
+		// Skip files that are currently being written by 'ini_file::flush_cache', they are picked up again on the next call to it
+		const auto it = std::find_if(s_ini_save_queue.begin(), s_ini_save_queue.end(),
+			[](const std::pair<const std::filesystem::path::string_type, ini_save_request> &queued) { return s_ini_save_in_progress.find(queued.first) == s_ini_save_in_progress.end(); });
+		if (it == s_ini_save_queue.end())
+			break;
+
+		const std::filesystem::path::string_type path = it->first;
+		const ini_save_request request = std::move(it->second);
+		s_ini_save_queue.erase(it);
+
+		s_ini_save_in_progress.insert(path);
+		lock.unlock();
+
+		ini_saved_state saved_state;
+		const bool success = write_ini_file(path, *request.sections, request.modified_at, saved_state);
+
+		lock.lock();
+		finish_ini_save(path, success, saved_state);
+
+		if (!success)
+			s_ini_save_failed = true;
+	}
+
+	s_ini_save_scheduled = false;
+}
+
 reshade::ini_file &reshade::global_config()
 {
 	return ini_file::load_cache(g_reshade_base_path / L"ReShade.ini");
@@ -26,13 +202,39 @@ reshade::ini_file::ini_file(const std::filesystem::path &path) : _path(path)
 
 bool reshade::ini_file::load()
 {
+	_checked_at = std::chrono::steady_clock::now();
+
+	// Pick up the state of the file after it was written in the background, so that this does not consider it changed
+	// Only do so if the file was loaded before, since the written data was taken from this instance then (a new instance still has to parse it and leaves the state for the cached instance)
+	if (_file_size != 0)
+	{
+		const std::unique_lock<std::mutex> lock(s_ini_save_mutex);
+		if (const auto it = s_ini_saved_states.find(_path.native()); it != s_ini_saved_states.end())
+		{
+			_file_modified_at = it->second.modified_at;
+			_file_size = it->second.size;
+			s_ini_saved_states.erase(it);
+		}
+	}
+
+	// Query last write time and size together, since a directory entry caches all attributes from a single file system request
 	std::error_code ec;
-	const std::filesystem::file_time_type modified_at = std::filesystem::last_write_time(_path, ec);
-	if (!ec && _modified_at >= modified_at)
-		return true; // Skip loading if there was no modification to the file since it was last loaded
+	const std::filesystem::directory_entry entry(_path, ec);
+	const std::filesystem::file_time_type modified_at = entry.last_write_time(ec);
+	const uintmax_t file_size = ec ? 0 : entry.file_size(ec);
+	// Compare for equality rather than order, so that files replaced by an older copy (e.g. after 'copy_file', which preserves the write time) are still detected
+	if (!ec && _file_modified_at == modified_at && _file_size == file_size)
+		return true; // Skip loading if the file did not change since it was last loaded or saved
+
+	_file_modified_at = {};
+	_file_size = 0;
 
 	// Clear when file does not exist too
-	_sections.clear();
+	_sections = std::make_shared<std::unordered_map<std::string, section_type>>();
+	_sections_shared = false;
+
+	if (ec)
+		return false;
 
 	FILE *const file = _wfsopen(_path.c_str(), L"r", SH_DENYWR);
 	if (file == nullptr)
@@ -40,6 +242,8 @@ bool reshade::ini_file::load()
 
 	_modified = false;
 	_modified_at = modified_at;
+	_file_modified_at = modified_at;
+	_file_size = file_size;
 
 	// Remove BOM (0xefbbbf means 0xfeff)
 	if (fgetc(file) != utf8::bom[0] || fgetc(file) != utf8::bom[1] || fgetc(file) != utf8::bom[2])
@@ -78,12 +282,12 @@ bool reshade::ini_file::load()
 
 			if (value.empty())
 			{
-				_sections[section].insert({ std::string(key), {} });
+				(*_sections)[section].insert({ std::string(key), {} });
 				continue;
 			}
 
 			// Append to key if it already exists
-			ini_file::value_type &elements = _sections[section][std::string(key)];
+			ini_file::value_type &elements = (*_sections)[section][std::string(key)];
 			for (size_t offset = 0, base = 0, len = value.size(); offset <= len;)
 			{
 				// Treat ",," as an escaped comma and only split on single ","
@@ -112,7 +316,7 @@ bool reshade::ini_file::load()
 		}
 		else
 		{
-			_sections[section].insert({ std::string(line), {} });
+			(*_sections)[section].insert({ std::string(line), {} });
 		}
 	}
 
@@ -128,111 +332,46 @@ bool reshade::ini_file::save()
 	// Reset state even on failure to avoid 'flush_cache' repeatedly trying and failing to save
 	_modified = false;
 
-	std::error_code ec;
-	const std::filesystem::file_time_type modified_at = std::filesystem::last_write_time(_path, ec);
-	if (!ec && (modified_at - _modified_at) > std::chrono::seconds(2))
-		return false; // File exists and was modified on disk and therefore may have different data, so cannot save
-
-	std::string data;
-	std::vector<std::string> section_names, key_names;
-
-	section_names.reserve(_sections.size());
-	for (const std::pair<const std::string, section_type> &section : _sections)
-		section_names.push_back(section.first);
-
-	// Sort sections to generate consistent files
-	std::sort(section_names.begin(), section_names.end(),
-		[](std::string a, std::string b) {
-			std::transform(a.begin(), a.end(), a.begin(), [](std::string::value_type c) { return static_cast<std::string::value_type>(std::toupper(c)); });
-			std::transform(b.begin(), b.end(), b.begin(), [](std::string::value_type c) { return static_cast<std::string::value_type>(std::toupper(c)); });
-			return a < b;
-		});
-
-	for (const std::string &section_name : section_names)
-	{
-		if (const section_type &keys = _sections.at(section_name); !keys.empty())
-		{
-			key_names.clear();
-			key_names.reserve(keys.size());
-			for (const std::pair<const std::string, value_type> &key : keys)
-				key_names.push_back(key.first);
-
-			std::sort(key_names.begin(), key_names.end(),
-				[](std::string a, std::string b) {
-					std::transform(a.begin(), a.end(), a.begin(), [](std::string::value_type c) { return static_cast<std::string::value_type>(std::toupper(c)); });
-					std::transform(b.begin(), b.end(), b.begin(), [](std::string::value_type c) { return static_cast<std::string::value_type>(std::toupper(c)); });
-					return a < b;
-				});
-
-			// Empty section should have been sorted to the top, so do not need to append it before keys
-			if (!section_name.empty())
-				data += '[' + section_name + ']' + '\n';
-
-			for (const std::string &key_name : key_names)
-			{
-				data += key_name + '=';
-
-				if (const ini_file::value_type &elements = keys.at(key_name); !elements.empty())
-				{
-					std::string value;
-					for (const std::string &element : elements)
-					{
-						// Empty elements mess with escaped commas, so simply skip them
-						if (element.empty())
-							continue;
-
-						value.reserve(value.size() + element.size() + 1);
-						for (const char c : element)
-							value.append(c == ',' ? 2 : 1, c);
-						value += ','; // Separate multiple values with a comma
-					}
-
-					// Remove the last comma
-					if (!value.empty())
-					{
-						assert(value.back() == ',');
-						value.pop_back();
-					}
-
-					data += value;
-				}
-
-				data += '\n';
-			}
-
-			data += '\n';
-		}
-	}
-
-	FILE *const file = _wfsopen(_path.c_str(), L"w", SH_DENYWR);
-	if (file == nullptr)
-		return false;
-	const size_t file_size_written = fwrite(data.data(), 1, data.size(), file);
-	fclose(file);
-	if (file_size_written != data.size())
+	ini_saved_state saved_state;
+	if (!write_ini_file(_path, *_sections, _modified_at, saved_state))
 		return false;
 
-	// Flush stream to disk before updating last write time
-	_modified_at = std::filesystem::last_write_time(_path, ec);
-
-	assert(!ec && std::filesystem::file_size(_path, ec) > 0);
+	_modified_at = saved_state.modified_at;
+	_file_modified_at = saved_state.modified_at;
+	_file_size = saved_state.size;
+	_checked_at = std::chrono::steady_clock::now();
 
 	return true;
 }
 
-bool reshade::ini_file::flush_cache()
+bool reshade::ini_file::flush_cache(thread_pool &pool)
 {
-	bool success = true;
-
 	const std::shared_lock<std::shared_mutex> lock(s_ini_cache_mutex);
+	const std::unique_lock<std::mutex> save_lock(s_ini_save_mutex);
 
-	// Save all files that were modified in one second intervals
+	// Queue all files that were modified in one second intervals
 	for (auto &file : s_ini_cache)
+	{
 		// Check modified status before requesting file time, since the latter is costly and therefore should be avoided when not necessary
 		if (file.second->_modified && (std::filesystem::file_time_type::clock::now() - file.second->_modified_at) > std::chrono::seconds(1))
-			success &= file.second->save();
+		{
+			file.second->_modified = false;
 
-	return success;
+			// Only share the sections here, they are copied on the next modification (see 'modify_sections'), and replace any older save of this file that was not written yet
+			file.second->_sections_shared = true;
+			s_ini_save_queue[file.first] = { file.second->_sections, file.second->_modified_at };
+		}
+	}
+
+	// Write files on the thread pool, so that this never blocks on disk access
+	if (!s_ini_save_queue.empty() && !s_ini_save_scheduled)
+	{
+		s_ini_save_scheduled = true;
+		pool.submit(&process_ini_save_queue);
+	}
+
+	// Failures of background writes are only reported on the next call
+	return !std::exchange(s_ini_save_failed, false);
 }
 bool reshade::ini_file::flush_cache(const std::filesystem::path &path)
 {
@@ -241,7 +380,40 @@ bool reshade::ini_file::flush_cache(const std::filesystem::path &path)
 	const std::shared_lock<std::shared_mutex> lock(s_ini_cache_mutex);
 
 	const auto it = s_ini_cache.find(path);
-	return it != s_ini_cache.end() && it->second->save();
+	if (it == s_ini_cache.end())
+		return false;
+
+	std::unique_lock<std::mutex> save_lock(s_ini_save_mutex);
+
+	// Wait for a background write of this file that is still in progress, so that it cannot overwrite the data written below afterwards
+	s_ini_save_finished.wait(save_lock, [&path]() { return s_ini_save_in_progress.find(path.native()) == s_ini_save_in_progress.end(); });
+
+	ini_save_request request;
+	if (const auto queue_it = s_ini_save_queue.find(path.native()); queue_it != s_ini_save_queue.end())
+	{
+		request = std::move(queue_it->second);
+		s_ini_save_queue.erase(queue_it);
+	}
+	if (it->second->_modified)
+	{
+		it->second->_modified = false;
+		it->second->_sections_shared = true;
+		request = { it->second->_sections, it->second->_modified_at };
+	}
+
+	if (request.sections == nullptr)
+		return true;
+
+	s_ini_save_in_progress.insert(path.native());
+	save_lock.unlock();
+
+	ini_saved_state saved_state;
+	const bool success = write_ini_file(path, *request.sections, request.modified_at, saved_state);
+
+	save_lock.lock();
+	finish_ini_save(path.native(), success, saved_state);
+
+	return success;
 }
 
 void reshade::ini_file::clear_cache()
@@ -281,7 +453,8 @@ reshade::ini_file &reshade::ini_file::load_cache(const std::filesystem::path &pa
 	if (insert.second)
 		it->second = std::make_unique<ini_file>(path);
 	// Don't reload file when it was just loaded or there are still modifications pending
-	else if (!it->second->_modified)
+	// Also limit how often the file system is polled for changes, since this is called repeatedly for the same file (e.g. once for every effect during loading)
+	else if (!it->second->_modified && (std::chrono::steady_clock::now() - it->second->_checked_at) > std::chrono::seconds(1))
 		it->second->load();
 
 	return *it->second;
@@ -8,7 +8,9 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <memory>
 #include <filesystem>
+#include <chrono>
 
 extern std::filesystem::path g_reshade_dll_path;
 extern std::filesystem::path g_reshade_base_path;
@@ -22,6 +24,8 @@ inline std::string_view trim(std::string_view str, const char chars[] = " \t")
 
 namespace reshade
 {
+	class thread_pool;
+
 	class ini_file
 	{
 	public:
@@ -41,8 +45,8 @@ namespace reshade
 		/// </summary>
 		bool has(const std::string &section, const std::string &key) const
 		{
-			const auto it1 = _sections.find(section);
-			if (it1 == _sections.end())
+			const auto it1 = _sections->find(section);
+			if (it1 == _sections->end())
 				return false;
 			const auto it2 = it1->second.find(key);
 			if (it2 == it1->second.end())
@@ -58,8 +62,8 @@ namespace reshade
 		template <typename T>
 		bool get(const std::string &section, const std::string &key, T &value) const
 		{
-			const auto it1 = _sections.find(section);
-			if (it1 == _sections.end())
+			const auto it1 = _sections->find(section);
+			if (it1 == _sections->end())
 				return false;
 			const auto it2 = it1->second.find(key);
 			if (it2 == it1->second.end())
@@ -70,8 +74,8 @@ namespace reshade
 		template <typename T, size_t SIZE>
 		bool get(const std::string &section, const std::string &key, T(&values)[SIZE]) const
 		{
-			const auto it1 = _sections.find(section);
-			if (it1 == _sections.end())
+			const auto it1 = _sections->find(section);
+			if (it1 == _sections->end())
 				return false;
 			const auto it2 = it1->second.find(key);
 			if (it2 == it1->second.end())
@@ -83,8 +87,8 @@ namespace reshade
 		template <typename T>
 		bool get(const std::string &section, const std::string &key, std::vector<T> &values) const
 		{
-			const auto it1 = _sections.find(section);
-			if (it1 == _sections.end())
+			const auto it1 = _sections->find(section);
+			if (it1 == _sections->end())
 				return false;
 			const auto it2 = it1->second.find(key);
 			if (it2 == it1->second.end())
@@ -132,7 +136,7 @@ namespace reshade
 		template <typename T>
 		void set(const std::string &section, const std::string &key, const T &value)
 		{
-			auto &v = _sections[section][key];
+			auto &v = modify_sections()[section][key];
 			if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, const char *>)
 			{
 				v.assign(1, value);
@@ -155,7 +159,7 @@ namespace reshade
 		template <typename T, size_t SIZE>
 		void set(const std::string &section, const std::string &key, const T(&values)[SIZE], const size_t size = SIZE)
 		{
-			auto &v = _sections[section][key];
+			auto &v = modify_sections()[section][key];
 			v.resize(size);
 			for (size_t i = 0; i < size; ++i)
 				v[i] = std::to_string(values[i]);
@@ -165,7 +169,7 @@ namespace reshade
 		template <typename T>
 		void set(const std::string &section, const std::string &key, const std::vector<T> &values)
 		{
-			auto &v = _sections[section][key];
+			auto &v = modify_sections()[section][key];
 			if constexpr (std::is_same_v<T, std::string>)
 			{
 				v = values;
@@ -205,7 +209,7 @@ namespace reshade
 
 		void set(const std::string &section, const std::string &key, std::string &&value)
 		{
-			auto &v = _sections[section][key];
+			auto &v = modify_sections()[section][key];
 			v.resize(1);
 			v[0] = std::forward<std::string>(value);
 			_modified = true;
@@ -213,7 +217,7 @@ namespace reshade
 		}
 		void set(const std::string &section, const std::string &key, std::vector<std::string> &&values)
 		{
-			auto &v = _sections[section][key];
+			auto &v = modify_sections()[section][key];
 			v = std::forward<std::vector<std::string>>(values);
 			_modified = true;
 			_modified_at = std::filesystem::file_time_type::clock::now();
@@ -224,7 +228,8 @@ namespace reshade
 		/// </summary>
 		void clear()
 		{
-			_sections.clear();
+			_sections = std::make_shared<std::unordered_map<std::string, section_type>>();
+			_sections_shared = false;
 			_modified = true;
 			_modified_at = std::filesystem::file_time_type::clock::now();
 		}
@@ -234,19 +239,15 @@ namespace reshade
 		/// </summary>
 		void remove_key(const std::string &section, const std::string &key)
 		{
-			const auto it1 = _sections.find(section);
-			if (it1 == _sections.end())
-				return;
-			const auto it2 = it1->second.find(key);
-			if (it2 == it1->second.end())
+			if (!has(section, key))
 				return;
-			it1->second.erase(it2);
+			modify_sections().at(section).erase(key);
 			_modified = true;
 			_modified_at = std::filesystem::file_time_type::clock::now();
 		}
 
 		/// <summary>
-		/// Loads all values from disk.
+		/// Loads all values from disk, unless the file did not change since it was last loaded or saved.
 		/// </summary>
 		bool load();
 		/// <summary>
@@ -255,9 +256,15 @@ namespace reshade
 		bool save();
 
 		/// <summary>
-		/// Saves all changes to INI files that were loaded through <see cref="load_cache"/> to disk.
+		/// Saves all changes to INI files that were loaded through <see cref="load_cache"/> to disk in the background.
+		/// Files are only written after they were not modified for a second, and multiple saves of the same file that are still pending are combined into one.
+		/// </summary>
+		/// <param name="pool">Thread pool to execute the file writes on.</param>
+		/// <returns><see langword="false"/> if a previous background save failed, <see langword="true"/> otherwise.</returns>
+		static bool flush_cache(thread_pool &pool);
+		/// <summary>
+		/// Saves all changes to the specified INI file that was loaded through <see cref="load_cache"/> to disk and waits for the write to finish.
 		/// </summary>
-		static bool flush_cache();
 		static bool flush_cache(const std::filesystem::path &path);
 
 		/// <summary>
@@ -281,6 +288,21 @@ namespace reshade
 		static ini_file &load_cache(const std::filesystem::path &path);
 
 	private:
+		/// <summary>
+		/// Gets the sections for modification, copying them first if they were handed to a background save.
+		/// </summary>
+		std::unordered_map<std::string, std::unordered_map<std::string, std::vector<std::string>>> &modify_sections()
+		{
+			// Shared sections are never modified again, since the save may read them at any time without synchronizing with this instance
+			// This cannot rely on the reference count instead, since a save releasing its reference does not guarantee its reads happened before the modification
+			if (_sections_shared)
+			{
+				_sections = std::make_shared<std::unordered_map<std::string, section_type>>(*_sections);
+				_sections_shared = false;
+			}
+			return *_sections;
+		}
+
 		template <typename T>
 		static const T convert(const std::vector<std::string> &values, size_t i)
 		{
@@ -318,9 +340,16 @@ namespace reshade
 		using section_type = std::unordered_map<std::string, value_type>;
 
 		const std::filesystem::path _path;
-		std::unordered_map<std::string, section_type> _sections;
+		// Sections are shared with pending background saves and copied on the next modification (see 'modify_sections')
+		std::shared_ptr<std::unordered_map<std::string, section_type>> _sections = std::make_shared<std::unordered_map<std::string, section_type>>();
+		// Set when the current sections were handed to a background save and therefore have to be treated as immutable
+		bool _sections_shared = false;
 		bool _modified = false;
 		std::filesystem::file_time_type _modified_at;
+		// Last write time and size of the file on disk when it was last loaded or saved, used to detect changes
+		std::filesystem::file_time_type _file_modified_at;
+		uintmax_t _file_size = 0;
+		std::chrono::steady_clock::time_point _checked_at;
 	};
 
 	/// <summary>
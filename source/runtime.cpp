@@ -12,18 +12,20 @@
 #include "dll_log.hpp"
 #include "dll_resources.hpp"
 #include "ini_file.hpp"
+#include "effect_cache.hpp"
 #include "addon_manager.hpp"
 #include "input.hpp"
 #include "platform_utils.hpp"
 #include "reshade_api_object_impl.hpp"
 #include <set>
+#include <atomic>
 #include <cmath> // std::abs, std::fmod
 #include <cctype> // std::toupper
 #include <cwctype> // std::towlower
 #include <cstdio> // std::snprintf
 #include <cstdlib> // std::malloc, std::rand, std::strtod, std::strtol
 #include <cstring> // std::memcpy, std::memset, std::strlen
-#include <algorithm> // std::all_of, std::copy_n, std::equal, std::fill_n, std::find, std::find_if, std::for_each, std::max, std::min, std::replace, std::remove, std::remove_if, std::reverse, std::search, std::set_symmetric_difference, std::sort, std::stable_sort, std::swap, std::transform
+#include <algorithm> // std::all_of, std::copy_n, std::equal, std::fill_n, std::find, std::find_if, std::for_each, std::lower_bound, std::max, std::min, std::replace, std::remove, std::remove_if, std::reverse, std::search, std::set_symmetric_difference, std::sort, std::stable_sort, std::swap, std::transform, std::upper_bound
 #include <emmintrin.h>
 #include <smmintrin.h>
 #include <immintrin.h>
@@ -192,6 +194,18 @@ static std::filesystem::path make_relative_path(const std::filesystem::path &pat
 	return proximate_path;
 }
 
+/// <summary>
+/// Builds the key a preset file is identified by in a preset catalog, from the canonical path of the directory it is in and its file name.
+/// Names are compared case-insensitively, like the file system does.
+/// </summary>
+static std::filesystem::path::string_type make_preset_catalog_key(const std::filesystem::path &canonical_parent_path, const std::filesystem::path &file_name)
+{
+	std::filesystem::path::string_type key = (canonical_parent_path / file_name).native();
+	std::transform(key.begin(), key.end(), key.begin(),
+		[](std::filesystem::path::value_type c) { return static_cast<std::filesystem::path::value_type>(std::towlower(c)); });
+	return key;
+}
+
 static bool find_file(const std::vector<std::filesystem::path> &search_paths, std::filesystem::path &path)
 {
 	std::error_code ec;
@@ -356,7 +370,9 @@ reshade::runtime::runtime(api::swapchain *swapchain, api::command_queue *graphic
 }
 reshade::runtime::~runtime()
 {
-	assert(_worker_threads.empty());
+	// Make sure background tasks (like screenshot encoding) have finished before destroying any state they may access
+	_worker_pool.wait_idle();
+
 	assert(!_is_initialized && _techniques.empty() && _technique_sorting.empty());
 
 #if RESHADE_GUI
@@ -946,7 +962,7 @@ void reshade::runtime::on_present()
 		_input_gamepad->next_frame();
 
 	// Save modified INI files
-	if (!ini_file::flush_cache())
+	if (!ini_file::flush_cache(_worker_pool))
 		_preset_save_successful = false;
 
 /*#if RESHADE_ADDON == 1
@@ -1018,6 +1034,7 @@ void reshade::runtime::load_config()
 	config_get("GENERAL", "SkipLoadingDisabledEffects", _effect_load_skipping);
 	config_get("GENERAL", "TextureSearchPaths", _texture_search_paths);
 	config_get("GENERAL", "IntermediateCachePath", _effect_cache_path);
+	config_get("GENERAL", "IntermediateCacheSizeLimit", _effect_cache_size_limit);
 
 	config_get("GENERAL", "StartupPresetPath", _startup_preset_path);
 	config_get("GENERAL", "PresetPath", _current_preset_path);
@@ -1095,6 +1112,7 @@ void reshade::runtime::save_config() const
 	config.set("GENERAL", "SkipLoadingDisabledEffects", _effect_load_skipping);
 	config.set("GENERAL", "TextureSearchPaths", _texture_search_paths);
 	config.set("GENERAL", "IntermediateCachePath", _effect_cache_path);
+	config.set("GENERAL", "IntermediateCacheSizeLimit", _effect_cache_size_limit);
 
 	config.set("GENERAL", "StartupPresetPath", make_relative_path(_startup_preset_path));
 	config.set("GENERAL", "PresetPath", make_relative_path(_current_preset_path));
@@ -1140,9 +1158,39 @@ void reshade::runtime::save_config() const
 
 void reshade::runtime::load_current_preset()
 {
+	// Only blend between the values that were resolved when the transition started, instead of loading the preset again every frame
+	// Effects must not be loading, since uniforms may be added or removed then
+	// The preset path has to match as well, since it may be changed before the switching time is updated (e.g. when selecting a preset in the overlay), in which case the plan still blends to the old preset
+	if (_is_in_preset_transition && !is_loading() && _preset_transition_plan.switching_time == _last_preset_switching_time && _preset_transition_plan.preset_path == _current_preset_path)
+	{
+		const int64_t transition_time = std::chrono::duration_cast<std::chrono::microseconds>(_last_present_time - _last_preset_switching_time).count();
+		const int64_t transition_duration = static_cast<int64_t>(_preset_transition_duration) * 1000;
+
+		// Fall through to a full load when the transition ended, so that the exact preset values are applied
+		if (transition_time < transition_duration && _preset_transition_plan.start_time < transition_duration)
+		{
+			const float t = static_cast<float>(transition_time - _preset_transition_plan.start_time) / static_cast<float>(transition_duration - _preset_transition_plan.start_time);
+
+			std::vector<float> &values = _preset_transition_plan.values;
+			const std::vector<float> &start_values = _preset_transition_plan.start_values;
+			const std::vector<float> &end_values = _preset_transition_plan.end_values;
+
+			values.resize(start_values.size());
+			for (size_t i = 0; i < values.size(); ++i)
+				values[i] = start_values[i] + (end_values[i] - start_values[i]) * t;
+
+			for (const preset_transition_plan::target &target : _preset_transition_plan.targets)
+				set_uniform_value(_effects[target.effect_index].uniforms[target.uniform_index], values.data() + target.value_index, target.value_count);
+			return;
+		}
+	}
+
 	_preset_is_incomplete = false;
 	_preset_save_successful = true;
 
+	// Build the catalog key here already, so that 'switch_to_next_preset' does not have to access the file system for it on a key press
+	update_current_preset_catalog_key();
+
 	const ini_file &preset = ini_file::load_cache(_current_preset_path);
 
 	std::vector<std::string> technique_list;
@@ -1251,6 +1299,12 @@ void reshade::runtime::load_current_preset()
 	if (_is_in_preset_transition && transition_ms_left <= 0)
 		_is_in_preset_transition = false;
 
+	_preset_transition_plan.switching_time = {};
+	_preset_transition_plan.preset_path.clear();
+	_preset_transition_plan.targets.clear();
+	_preset_transition_plan.start_values.clear();
+	_preset_transition_plan.end_values.clear();
+
 	for (effect &effect : _effects)
 	{
 		const std::string effect_name = effect.source_file.filename().u8string();
@@ -1292,12 +1346,19 @@ void reshade::runtime::load_current_preset()
 				preset.get(effect_name, variable.name, values.as_float);
 				if (_is_in_preset_transition)
 				{
+					// Remember the values this transition goes between, so that the following frames can blend them without loading the preset (see above)
+					_preset_transition_plan.targets.push_back({ variable.effect_index, static_cast<size_t>(&variable - effect.uniforms.data()), _preset_transition_plan.start_values.size(), variable.type.components() });
+					_preset_transition_plan.end_values.insert(_preset_transition_plan.end_values.end(), values.as_float, values.as_float + variable.type.components());
+
 					// Perform smooth transition on floating point values
 					for (unsigned int i = 0; i < variable.type.components(); i++)
 					{
 						const float value_left = (values.as_float[i] - values_old.as_float[i]);
 						values.as_float[i] -= (value_left / transition_ms_left_from_last_frame) * transition_ms_left;
 					}
+
+					// Start blending from the values applied in this frame
+					_preset_transition_plan.start_values.insert(_preset_transition_plan.start_values.end(), values.as_float, values.as_float + variable.type.components());
 				}
 				set_uniform_value(variable, values.as_float, variable.type.components());
 				break;
@@ -1305,6 +1366,13 @@ void reshade::runtime::load_current_preset()
 		}
 	}
 
+	if (_is_in_preset_transition)
+	{
+		_preset_transition_plan.switching_time = _last_preset_switching_time;
+		_preset_transition_plan.preset_path = _current_preset_path;
+		_preset_transition_plan.start_time = transition_time;
+	}
+
 	for (technique &tech : _techniques)
 	{
 		const std::string unique_name = tech.name + '@' + _effects[tech.effect_index].source_file.filename().u8string();
@@ -1425,10 +1493,104 @@ void reshade::runtime::save_current_preset(ini_file &preset) const
 }
 
 bool reshade::runtime::switch_to_next_preset(std::filesystem::path filter_path, bool reversed)
+{
+	std::shared_ptr<preset_catalog> catalog;
+	{ const std::unique_lock<std::mutex> lock(_preset_catalog_mutex);
+		if (const auto it = _preset_catalogs.find(filter_path.native()); it != _preset_catalogs.end())
+			catalog = it->second;
+	}
+
+	if (catalog == nullptr)
+	{
+		// Only search the file system the first time a filter path is used, afterwards the catalog is refreshed in the background
+		catalog = build_preset_catalog(filter_path, nullptr);
+
+		const std::unique_lock<std::mutex> lock(_preset_catalog_mutex);
+		_preset_catalogs[filter_path.native()] = catalog;
+	}
+	else if (!catalog->refresh_scheduled && (std::chrono::steady_clock::now() - catalog->refreshed_at) > std::chrono::seconds(1))
+	{
+		// Use the existing catalog for this switch and pick up added, removed or changed preset files for the next one
+		catalog->refresh_scheduled = true;
+
+		_worker_pool.submit([this, filter_path, catalog]() {
+			std::shared_ptr<preset_catalog> refreshed_catalog = build_preset_catalog(filter_path, catalog.get());
+
+			const std::unique_lock<std::mutex> lock(_preset_catalog_mutex);
+			_preset_catalogs[filter_path.native()] = std::move(refreshed_catalog);
+		});
+	}
+
+	if (!catalog->single_preset_path.empty())
+	{
+		_current_preset_path = catalog->single_preset_path;
+		_last_preset_switching_time = _last_present_time;
+		_is_in_preset_transition = true;
+
+		return true;
+	}
+
+	size_t next_preset_index;
+	const std::vector<size_t> &matching_entries = catalog->matching_entries;
+
+	// This is usually a no-op, since the key is already built when the current preset is loaded
+	update_current_preset_catalog_key();
+
+	const auto current_preset_it = catalog->entry_indices.find(_current_preset_catalog_key);
+
+	// The catalog only sees the file on disk, which may not contain the technique list yet while a save of the current preset is still pending, so check the cached instance for it instead
+	// Only look at an instance that is already in memory, to avoid touching the file system here
+	const ini_file *const current_preset = ini_file::find_cache(_current_preset_path);
+
+	if (current_preset_it == catalog->entry_indices.end() ||
+		!(catalog->entries[current_preset_it->second].valid || (current_preset != nullptr && current_preset->has({}, "Techniques"))))
+	{
+		if (matching_entries.empty())
+			return false; // No valid preset files were found, so nothing more to do
+
+		// Current preset was not in the filter path, so just use the first or last file
+		if (reversed)
+			next_preset_index = matching_entries.back();
+		else
+			next_preset_index = matching_entries.front();
+	}
+	else
+	{
+		// Current preset was found in the filter path, so use the file before or after it
+		// The current preset is part of the cycle even if its name does not match the filter text, so compare indices in directory order instead of looking it up in the matching entries
+		const size_t current_preset_index = current_preset_it->second;
+
+		if (reversed)
+		{
+			const auto it = std::lower_bound(matching_entries.begin(), matching_entries.end(), current_preset_index);
+			next_preset_index = (it != matching_entries.begin()) ? *std::prev(it) : matching_entries.empty() ? current_preset_index : std::max(matching_entries.back(), current_preset_index);
+		}
+		else
+		{
+			const auto it = std::upper_bound(matching_entries.begin(), matching_entries.end(), current_preset_index);
+			next_preset_index = (it != matching_entries.end()) ? *it : matching_entries.empty() ? current_preset_index : std::min(matching_entries.front(), current_preset_index);
+		}
+	}
+
+	_current_preset_path = catalog->entries[next_preset_index].path;
+	_last_preset_switching_time = _last_present_time;
+	_is_in_preset_transition = true;
+
+	// The key of the new current preset is already known from the catalog
+	_current_preset_catalog_key_path = _current_preset_path;
+	_current_preset_catalog_key = catalog->entries[next_preset_index].key;
+
+	return true;
+}
+
+std::shared_ptr<reshade::runtime::preset_catalog> reshade::runtime::build_preset_catalog(std::filesystem::path filter_path, const preset_catalog *previous_catalog)
 {
 	std::error_code ec; // This is here to ignore file system errors below
 	std::wstring filter_text;
 
+	const auto catalog = std::make_shared<preset_catalog>();
+	catalog->refreshed_at = std::chrono::steady_clock::now();
+
 	resolve_path(filter_path, ec);
 
 	if (const std::filesystem::file_type file_type = std::filesystem::status(filter_path, ec).type();
@@ -1442,63 +1604,84 @@ bool reshade::runtime::switch_to_next_preset(std::filesystem::path filter_path,
 		}
 		else
 		{
-			_current_preset_path = filter_path;
-			_last_preset_switching_time = _last_present_time;
-			_is_in_preset_transition = true;
-
-			return true;
+			catalog->single_preset_path = std::move(filter_path);
+			return catalog;
 		}
 	}
 
-	size_t current_preset_index = std::numeric_limits<size_t>::max();
-	std::vector<std::filesystem::path> preset_paths;
+	// Canonicalize the directory once, rather than every file in it, to build the keys identifying its files
+	std::filesystem::path canonical_filter_path = std::filesystem::weakly_canonical(filter_path, ec);
+	if (ec)
+		canonical_filter_path = filter_path;
 
-	for (std::filesystem::path preset_path : std::filesystem::directory_iterator(filter_path, std::filesystem::directory_options::skip_permission_denied, ec))
+	for (const std::filesystem::directory_entry &directory_entry : std::filesystem::directory_iterator(filter_path, std::filesystem::directory_options::skip_permission_denied, ec))
 	{
-		// Skip anything that is not a valid preset file
-		if (!resolve_preset_path(preset_path, ec))
+		// Skip anything that cannot be a preset file, using the attributes that were already retrieved during directory iteration
+		if (const std::filesystem::path ext = directory_entry.path().extension();
+			(ext != L".ini" && ext != L".txt") || !directory_entry.is_regular_file(ec))
 			continue;
 
-		// Keep track of the index of the current preset in the list of found preset files that is being build
-		if (std::filesystem::equivalent(preset_path, _current_preset_path, ec))
+		preset_catalog::entry &entry = catalog->entries.emplace_back();
+		entry.path = directory_entry.path();
+		entry.modified_at = directory_entry.last_write_time(ec);
+		entry.size = directory_entry.file_size(ec);
+
+		entry.key = make_preset_catalog_key(canonical_filter_path, entry.path.filename());
+
+		const preset_catalog::entry *previous_entry = nullptr;
+		if (previous_catalog != nullptr)
+			if (const auto it = previous_catalog->entry_indices.find(entry.key); it != previous_catalog->entry_indices.end())
+				previous_entry = &previous_catalog->entries[it->second];
+
+		// Only parse files that are new or changed since the catalog was last refreshed
+		if (previous_entry != nullptr && previous_entry->modified_at == entry.modified_at && previous_entry->size == entry.size)
 		{
-			current_preset_index = preset_paths.size();
-			preset_paths.push_back(std::move(preset_path));
-			continue;
+			entry.valid = previous_entry->valid;
+			entry.techniques = previous_entry->techniques;
+		}
+		else
+		{
+			// Ensure the file has a technique list, which should make it a preset
+			// This uses a separate instance instead of the INI cache, since it may run on a worker thread while the cached instance of the current preset is being modified
+			// Therefore this only sees what is on disk, which is why 'switch_to_next_preset' checks the cached instance of the current preset in addition
+			entry.valid = ini_file(entry.path).get({}, "Techniques", entry.techniques);
 		}
+	}
+
+	catalog->entry_indices.reserve(catalog->entries.size());
+
+	for (size_t i = 0; i < catalog->entries.size(); ++i)
+	{
+		const preset_catalog::entry &entry = catalog->entries[i];
+		catalog->entry_indices.emplace(entry.key, i);
 
-		const std::wstring preset_name = preset_path.stem().wstring();
+		if (!entry.valid)
+			continue;
+
+		const std::wstring preset_name = entry.path.stem().wstring();
 		// Only add those files that are matching the filter text
 		if (filter_text.empty() ||
 			std::search(preset_name.cbegin(), preset_name.cend(), filter_text.begin(), filter_text.end(),
 				[](auto c1, auto c2) { return std::towlower(c1) == std::towlower(c2); }) != preset_name.cend())
-			preset_paths.push_back(std::move(preset_path));
+			catalog->matching_entries.push_back(i);
 	}
 
-	if (preset_paths.empty())
-		return false; // No valid preset files were found, so nothing more to do
+	return catalog;
+}
 
-	if (current_preset_index == std::numeric_limits<size_t>::max())
-	{
-		// Current preset was not in the filter path, so just use the first or last file
-		if (reversed)
-			_current_preset_path = preset_paths.back();
-		else
-			_current_preset_path = preset_paths.front();
-	}
-	else
-	{
-		// Current preset was found in the filter path, so use the file before or after it
-		if (auto it = std::next(preset_paths.begin(), current_preset_index); reversed)
-			_current_preset_path = (it == preset_paths.begin()) ? preset_paths.back() : *(--it);
-		else
-			_current_preset_path = (it == std::prev(preset_paths.end())) ? preset_paths.front() : *(++it);
-	}
+void reshade::runtime::update_current_preset_catalog_key()
+{
+	if (_current_preset_catalog_key_path == _current_preset_path)
+		return;
 
-	_last_preset_switching_time = _last_present_time;
-	_is_in_preset_transition = true;
+	// Canonicalize the directory of the current preset the same way as the catalog did, so that it is found regardless of how its path is spelled (e.g. relative components, different case or through a junction)
+	std::error_code ec;
+	std::filesystem::path current_preset_parent_path = std::filesystem::weakly_canonical(_current_preset_path.parent_path(), ec);
+	if (ec)
+		current_preset_parent_path = _current_preset_path.parent_path();
 
-	return true;
+	_current_preset_catalog_key_path = _current_preset_path;
+	_current_preset_catalog_key = make_preset_catalog_key(current_preset_parent_path, _current_preset_path.filename());
 }
 
 bool reshade::runtime::load_effect(const std::filesystem::path &source_file, const ini_file &preset, size_t effect_index, size_t permutation_index, bool force_load, bool preprocess_required)
@@ -1550,52 +1733,47 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 	for (const std::pair<std::string, std::string> &definition : preprocessor_definitions)
 		attributes += definition.first + '=' + definition.second + ';';
 
-	std::error_code ec;
-	std::set<std::filesystem::path> include_paths;
-	if (source_file.is_absolute())
-		include_paths.emplace(source_file.parent_path());
-	for (std::filesystem::path include_path : _effect_search_paths)
-	{
-		const bool recursive_search = include_path.filename() == L"**";
-		if (recursive_search)
-			include_path.remove_filename();
-
-		if (resolve_path(include_path, ec))
-		{
-			include_paths.emplace(include_path);
-
-			if (recursive_search)
-			{
-				for (const std::filesystem::directory_entry &entry : std::filesystem::recursive_directory_iterator(include_path, std::filesystem::directory_options::skip_permission_denied, ec))
-					if (entry.is_directory(ec))
-						include_paths.emplace(entry);
-			}
-		}
-	}
+	for (const std::filesystem::path &search_path : _effect_search_paths)
+		attributes += search_path.u8string() + ';';
 
+	std::error_code ec;
 	attributes += effect_name;
 	attributes += '?';
 	attributes += std::to_string(std::filesystem::last_write_time(source_file, ec).time_since_epoch().count());
 	attributes += ';';
 
-	// The actual included files are not known at this point, so detect changes to any ".fxh" files in the search paths
-	for (const std::filesystem::path &include_path : include_paths)
-	{
-		for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(include_path, std::filesystem::directory_options::skip_permission_denied, ec))
+	effect &effect = _effects[effect_index];
+
+	// The actual included files are only known after preprocessing, so detect changes to those that were included during the previous build of this effect
+	// This avoids having to scan all search paths and means that modifying a header only invalidates the effects that actually include it
+	const auto hash_dependencies = [&attributes](const std::vector<std::filesystem::path> &included_files) {
+		std::string dependency_attributes = attributes;
+		std::error_code ec;
+		for (const std::filesystem::path &included_file : included_files)
 		{
-			if (entry.path().extension() == L".fxh")
-			{
-				attributes += entry.path().filename().u8string();
-				attributes += '?';
-				attributes += std::to_string(entry.last_write_time(ec).time_since_epoch().count());
-				attributes += ';';
-			}
+			dependency_attributes += included_file.u8string();
+			dependency_attributes += '?';
+			dependency_attributes += std::to_string(std::filesystem::last_write_time(included_file, ec).time_since_epoch().count());
+			dependency_attributes += ';';
 		}
-	}
+		return static_cast<size_t>(hash_data(dependency_attributes));
+	};
 
-	effect &effect = _effects[effect_index];
+	const std::string dependency_cache_id = source_file.stem().u8string() + '-' + std::to_string(_renderer_id) + '-' + std::to_string(hash_data(attributes));
 
-	const size_t source_hash = std::hash<std::string>()(attributes);
+	std::vector<std::filesystem::path> included_files;
+	if (source_file == effect.source_file && effect.preprocessed)
+	{
+		included_files = effect.included_files;
+	}
+	else if (std::string dependency_data;
+		load_effect_cache(dependency_cache_id, "dep", dependency_data))
+	{
+		for (size_t offset = 0, next; (next = dependency_data.find('\n', offset)) != std::string::npos; offset = next + 1)
+			included_files.push_back(std::filesystem::u8path(dependency_data.substr(offset, next - offset)));
+	}
+
+	size_t source_hash = hash_dependencies(included_files);
 	if (permutation_index == 0 && (source_file != effect.source_file || source_hash != effect.source_hash))
 	{
 		if (effect.created)
@@ -1673,6 +1851,28 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 		}
 		preprocessor_definitions.clear(); // Clear before reusing for used preprocessor definitions below
 
+		std::set<std::filesystem::path> include_paths;
+		if (source_file.is_absolute())
+			include_paths.emplace(source_file.parent_path());
+		for (std::filesystem::path include_path : _effect_search_paths)
+		{
+			const bool recursive_search = include_path.filename() == L"**";
+			if (recursive_search)
+				include_path.remove_filename();
+
+			if (resolve_path(include_path, ec))
+			{
+				include_paths.emplace(include_path);
+
+				if (recursive_search)
+				{
+					for (const std::filesystem::directory_entry &entry : std::filesystem::recursive_directory_iterator(include_path, std::filesystem::directory_options::skip_permission_denied, ec))
+						if (entry.is_directory(ec))
+							include_paths.emplace(entry);
+				}
+			}
+		}
+
 		for (const std::filesystem::path &include_path : include_paths)
 			pp.add_include_path(include_path);
 
@@ -1693,6 +1893,12 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 		// Append preprocessor errors to the error list
 		errors += pp.errors();
 
+		included_files = pp.included_files();
+		std::sort(included_files.begin(), included_files.end()); // Sort file names alphabetically
+
+		// Update hash with the actual list of included files, so that the next load can detect changes to them
+		source_hash = hash_dependencies(included_files);
+
 		if (preprocessed)
 		{
 			source = pp.output();
@@ -1714,16 +1920,22 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 			}
 
 			source_cached = save_effect_cache(source_file.stem().u8string() + '-' + std::to_string(_renderer_id) + '-' + std::to_string(source_hash), "i", source);
+
+			std::string dependency_data;
+			for (const std::filesystem::path &included_file : included_files)
+				dependency_data += included_file.u8string() + '\n';
+			save_effect_cache(dependency_cache_id, "dep", dependency_data);
 		}
 
 		if (permutation_index == 0)
 		{
+			effect.source_hash = source_hash;
+
 			effect.definitions = std::move(preprocessor_definitions);
 			std::sort(effect.definitions.begin(), effect.definitions.end());
 
 			// Keep track of included files
-			effect.included_files = pp.included_files();
-			std::sort(effect.included_files.begin(), effect.included_files.end()); // Sort file names alphabetically
+			effect.included_files = std::move(included_files);
 
 			effect.preprocessed = preprocessed;
 		}
@@ -1732,6 +1944,9 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 	{
 		if (permutation_index == 0 && !source.empty())
 		{
+			// Keep track of included files (as recorded during the build that populated the cache)
+			effect.included_files = std::move(included_files);
+
 			effect.definitions.clear();
 
 			// Read used preprocessor definitions from the cached source
@@ -1757,6 +1972,8 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 
 	std::unique_ptr<reshadefx::codegen> codegen;
 	size_t spec_constants_hash = 0;
+	uint64_t source_content_hash = 0;
+	uint64_t codegen_options_hash = 0;
 	if (!compiled && !source.empty())
 	{
 		unsigned shader_model;
@@ -1776,7 +1993,11 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 		else if (_renderer_id < 0x20000)
 			codegen.reset(reshadefx::create_codegen_glsl(false, !_no_debug_info, _performance_mode, false, true));
 		else // Vulkan uses SPIR-V input
-			codegen.reset(reshadefx::create_codegen_spirv(true, !_no_debug_info, _performance_mode, false, false));
+			codegen.reset(reshadefx::create_codegen_spirv(true, !_no_debug_info, _performance_mode, false, false, _performance_mode ? 3 : 1));
+
+		// Identify compiled shader modules by the actual pre-processed source code and code generation options, so that they are reused whenever that is unchanged
+		codegen_options_hash = hash_data(std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION) + ';' + std::to_string(shader_model) + ';' + (_no_debug_info ? '0' : '1') + (_performance_mode ? '1' : '0'));
+		source_content_hash = hash_data(source, codegen_options_hash);
 
 		reshadefx::parser parser;
 
@@ -1794,9 +2015,13 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 			if (permutation_index == 0)
 			{
 				effect.uniforms.clear();
+				effect.uniform_indices.clear();
+				effect.special_uniforms.clear();
 
 				// Create space for all variables (aligned to 16 bytes)
 				effect.uniform_data_storage.resize((permutation.module.total_uniform_size + 15) & ~15);
+				// Any range marked before refers to the previous layout, which may have been larger
+				effect.clear_uniform_data_dirty();
 
 				for (uniform variable : permutation.module.uniforms)
 				{
@@ -1838,9 +2063,48 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 					else
 						variable.special = special_uniform::unknown;
 
+					if (variable.special != special_uniform::none && variable.special != special_uniform::unknown)
+					{
+						special_uniform_info &info = effect.special_uniforms.emplace_back();
+						info.uniform_index = effect.uniforms.size();
+						info.source = variable.special;
+
+						switch (variable.special)
+						{
+						case special_uniform::random:
+							info.int_min = variable.annotation_as_int("min", 0, 0);
+							info.int_max = variable.annotation_as_int("max", 0, RAND_MAX);
+							break;
+						case special_uniform::ping_pong:
+							info.float_min = variable.annotation_as_float("min", 0, 0.0f);
+							info.float_max = variable.annotation_as_float("max", 0, 1.0f);
+							info.step_min = variable.annotation_as_float("step", 0);
+							info.step_max = variable.annotation_as_float("step", 1);
+							info.smoothing = variable.annotation_as_float("smoothing");
+							break;
+						case special_uniform::key:
+						case special_uniform::mouse_button:
+							info.keycode = variable.annotation_as_int("keycode");
+							if (const std::string_view mode = variable.annotation_as_string("mode");
+								mode == "toggle" || variable.annotation_as_int("toggle"))
+								info.mode = special_uniform_info::input_mode::toggle;
+							else if (mode == "press")
+								info.mode = special_uniform_info::input_mode::press;
+							break;
+						case special_uniform::mouse_wheel:
+							info.float_min = variable.annotation_as_float("min");
+							info.float_max = variable.annotation_as_float("max");
+							info.step_min = variable.annotation_as_float("step");
+							if (info.step_min == 0.0f)
+								info.step_min = 1.0f;
+							break;
+						}
+					}
+
 					// Copy initial data into uniform storage area
 					reset_uniform_value(variable);
 
+					effect.uniform_indices.emplace(variable.name, effect.uniforms.size());
 					effect.uniforms.push_back(std::move(variable));
 				}
 			}
@@ -1994,31 +2258,59 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 					break;
 				}
 
-				std::string &cso = permutation.cso[entry_point.first];
-				std::string &assembly = permutation.assembly[entry_point.first];
+				// Create all map entries up front, so that the tasks below only write to existing strings
+				permutation.cso[entry_point.first];
+				permutation.assembly[entry_point.first];
+			}
+
+			// Each entry point is assembled independently, so do so in parallel, but limit the number of threads working on a single effect, so that other effects that are loaded at the same time are not starved
+			std::vector<std::string> entry_point_errors(permutation.module.entry_points.size());
+			std::atomic<bool> entry_points_compiled = compiled;
 
-				const std::string cache_id = source_file.stem().u8string() + '-' + std::to_string(_renderer_id) + '-' + std::to_string(source_hash) + '-' + std::to_string(spec_constants_hash) + '-' + entry_point.first;
+			_worker_pool.parallel_for(permutation.module.entry_points.size(), [&](size_t i) {
+				// Stop early once any entry point failed, since the effect cannot be used anyway
+				if (!entry_points_compiled)
+					return;
+
+				const std::string &entry_point_name = permutation.module.entry_points[i].first;
+
+				std::string &cso = permutation.cso.at(entry_point_name);
+				std::string &assembly = permutation.assembly.at(entry_point_name);
+
+				// Prefer identifying the compiled entry point by only the code it references, so that editing one function of an effect does not cause all other entry points to be compiled again
+				uint64_t entry_point_hash = source_content_hash;
+				if (const size_t code_hash = codegen->hash_code_for_entry_point(entry_point_name); code_hash != 0)
+					entry_point_hash = hash_data(&code_hash, sizeof(code_hash), codegen_options_hash);
+
+				const std::string cache_id = source_file.stem().u8string() + '-' + std::to_string(_renderer_id) + '-' + std::to_string(entry_point_hash) + '-' + std::to_string(spec_constants_hash) + '-' + entry_point_name;
 
 				if (load_effect_cache(cache_id, "cso", cso) &&
 					load_effect_cache(cache_id, "asm", assembly))
 				{
-					continue;
+					return;
 				}
 				else
 				{
 					cso.clear();
 					assembly.clear();
 
-					if (!codegen->assemble_code_for_entry_point(entry_point.first, cso, assembly, errors))
+					if (!codegen->assemble_code_for_entry_point(entry_point_name, cso, assembly, entry_point_errors[i]))
 					{
-						compiled = false;
-						break;
+						entry_points_compiled = false;
+						return;
 					}
 
 					save_effect_cache(cache_id, "cso", cso);
 					save_effect_cache(cache_id, "asm", assembly);
 				}
-			}
+			}, _worker_pool.size() / 2 + 1);
+
+			// Append errors in entry point order, so that the output does not depend on which thread finished first
+			for (const std::string &entry_point_error : entry_point_errors)
+				errors += entry_point_error;
+
+			if (!entry_points_compiled)
+				compiled = false;
 		}
 
 		const std::unique_lock<std::shared_mutex> lock(_reload_mutex);
@@ -2378,6 +2670,9 @@ bool reshade::runtime::create_effect(size_t effect_index, size_t permutation_ind
 			}
 
 			_device->set_resource_name(effect.cb, "ReShade constant buffer");
+
+			// Constant buffer was created without initial data, so ensure the entire contents are uploaded before first use
+			effect.mark_uniform_data_dirty(0, effect.uniform_data_storage.size());
 		}
 		else
 		{
@@ -2760,11 +3055,18 @@ bool reshade::runtime::create_effect(size_t effect_index, size_t permutation_ind
 				if (!sampler_texture->semantic.empty())
 				{
 					if (sampler_texture->semantic == "COLOR")
+					{
 						srv = _effect_permutations[permutation_index].color_srv[binding.srgb];
+						pass.samples_back_buffer = true;
+					}
 					else if (const auto it = _texture_semantic_bindings.find(sampler_texture->semantic); it != _texture_semantic_bindings.end())
+					{
 						srv = binding.srgb ? it->second.second : it->second.first;
+					}
 					else
+					{
 						srv = _empty_srv;
+					}
 
 					// Keep track of the texture descriptor to simplify updating it
 					permutation.texture_semantic_to_binding.push_back({
@@ -2834,6 +3136,9 @@ void reshade::runtime::destroy_effect(size_t effect_index, bool unload)
 {
 	assert(effect_index < _effects.size());
 
+	// Uniforms referenced by the preset transition plan may be destroyed below, so force it to be recreated
+	_preset_transition_plan.switching_time = {};
+
 	for (technique &tech : _techniques)
 	{
 		if (tech.effect_index != effect_index)
@@ -2864,6 +3169,8 @@ void reshade::runtime::destroy_effect(size_t effect_index, bool unload)
 	{
 		_device->destroy_resource(effect.cb);
 		effect.cb = {};
+		// A new constant buffer is fully uploaded after creation, so a range left over from before must not carry over
+		effect.clear_uniform_data_dirty();
 
 		_device->destroy_query_heap(effect.query_heap);
 		effect.query_heap = {};
@@ -3430,21 +3737,19 @@ void reshade::runtime::load_effects(bool force_load_all)
 	_reload_remaining_effects = effect_files.size();
 
 	// Now that we have a list of files, load them in parallel
-	// Split workload into batches instead of launching a thread for every file to avoid launch overhead and stutters due to too many threads being in flight
-	size_t num_splits = std::min(effect_files.size(), static_cast<size_t>(std::max(std::thread::hardware_concurrency(), 2u) - 1));
-#ifndef _WIN64
-	// Limit number of threads in 32-bit due to the limited about of address space being available there and compilation being memory hungry
-	num_splits = std::min(num_splits, static_cast<size_t>(4));
-#endif
-
-	// Keep track of the spawned threads, so the runtime cannot be destroyed while they are still running
-	for (size_t n = 0; n < num_splits; ++n)
-		_worker_threads.emplace_back([this, effect_files, offset, num_splits, n, &preset, force_load_all]() {
-			// Abort loading when initialization state changes (indicating that 'on_reset' was called in the meantime)
-			for (size_t i = 0; i < effect_files.size() && _is_initialized; ++i)
-				if (i * num_splits / effect_files.size() == n)
-					load_effect(effect_files[i], preset, offset + i, 0, force_load_all || effect_files[i].extension() == L".addonfx");
-		});
+	// Queue a task per file and schedule by file size, so that the largest effects are started first and do not end up holding up the entire load at the end
+	// The worker threads are kept around, so the runtime cannot be destroyed while they are still running
+	for (size_t i = 0; i < effect_files.size(); ++i)
+	{
+		std::error_code ec;
+		const uintmax_t file_size = std::filesystem::file_size(effect_files[i], ec);
+
+		submit_effect_load_task([this, effect_file = effect_files[i], effect_index = offset + i, &preset, force_load_all]() {
+				// Abort loading when initialization state changes (indicating that 'on_reset' was called in the meantime)
+				if (_is_initialized)
+					load_effect(effect_file, preset, effect_index, 0, force_load_all || effect_file.extension() == L".addonfx");
+			}, ec ? 0 : static_cast<uint64_t>(file_size));
+	}
 }
 bool reshade::runtime::reload_effect(size_t effect_index)
 {
@@ -3460,6 +3765,9 @@ bool reshade::runtime::reload_effect(size_t effect_index)
 	const std::filesystem::path source_file = _effects[effect_index].source_file;
 	destroy_effect(effect_index);
 
+	// Textures and techniques of this effect were removed, so indices in the lookup tables changed
+	update_effect_name_index();
+
 #if RESHADE_ADDON
 	// Call event after destroying the effect, so add-ons get a chance to release any handles they hold to variables and techniques
 	invoke_addon_event<addon_event::reshade_reloaded_effects>(this);
@@ -3492,10 +3800,7 @@ void reshade::runtime::reload_effects(bool force_load_all)
 void reshade::runtime::destroy_effects()
 {
 	// Make sure no threads are still accessing effect data
-	for (std::thread &thread : _worker_threads)
-		if (thread.joinable())
-			thread.join();
-	_worker_threads.clear();
+	wait_for_effect_load_tasks();
 
 #if RESHADE_GUI
 	_effect_filter[0] = '\0';
@@ -3516,6 +3821,8 @@ void reshade::runtime::destroy_effects()
 	// Reset the effect list after all resources have been destroyed
 	_effects.clear();
 
+	update_effect_name_index();
+
 	// Clean up sampler objects
 	for (const auto &[hash, sampler] : _effect_sampler_states)
 		_device->destroy_sampler(sampler);
@@ -3526,48 +3833,85 @@ void reshade::runtime::destroy_effects()
 	assert(_techniques.empty() && _technique_sorting.empty());
 }
 
-bool reshade::runtime::load_effect_cache(const std::string &id, const std::string &type, std::string &data) const
+void reshade::runtime::submit_effect_load_task(std::function<void()> task, uint64_t cost)
 {
-	if (_no_effect_cache)
-		return false;
+	{ const std::unique_lock<std::mutex> lock(_reload_tasks_mutex);
+		_reload_tasks_running++;
+	}
 
-	std::filesystem::path path = g_reshade_base_path / _effect_cache_path;
-	path /= std::filesystem::u8path("reshade-" + id + '.' + type);
+	_worker_pool.submit([this, task = std::move(task)]() {
+		task();
 
-	FILE *const file = _wfsopen(path.c_str(), L"rb", SH_DENYNO);
-	if (file == nullptr)
-		return false;
+		// Notify while holding the lock, so that a waiting thread cannot return and continue before this task is done accessing the runtime
+		const std::unique_lock<std::mutex> lock(_reload_tasks_mutex);
+		if (--_reload_tasks_running == 0)
+			_reload_tasks_finished.notify_all();
+	}, cost);
+}
+
+void reshade::runtime::wait_for_effect_load_tasks()
+{
+	std::unique_lock<std::mutex> lock(_reload_tasks_mutex);
+	_reload_tasks_finished.wait(lock, [this]() { return _reload_tasks_running == 0; });
+}
+
+void reshade::runtime::update_effect_name_index()
+{
+	_effect_name_index.effect_file_names.clear();
+	_effect_name_index.effects.clear();
+	_effect_name_index.uniforms.clear();
+	_effect_name_index.textures.clear();
+	_effect_name_index.techniques.clear();
+
+	for (size_t effect_index = 0; effect_index < _effects.size(); ++effect_index)
+	{
+		const effect &effect = _effects[effect_index];
 
-	fseek(file, 0, SEEK_END);
-	const size_t file_size = ftell(file);
-	fseek(file, 0, SEEK_SET);
+		std::string file_name = effect.source_file.filename().u8string();
+		_effect_name_index.effects.emplace(file_name, effect_index);
+		_effect_name_index.effect_file_names.push_back(std::move(file_name));
 
-	data.resize(file_size, '\0');
-	const size_t file_size_read = fread(data.data(), 1, data.size(), file);
-	fclose(file);
-	return file_size_read == data.size();
+		// Only the first occurrence of a name is inserted, which matches the search order of a linear lookup through all effects
+		for (size_t uniform_index = 0; uniform_index < effect.uniforms.size(); ++uniform_index)
+			_effect_name_index.uniforms.emplace(effect.uniforms[uniform_index].name, std::make_pair(effect_index, uniform_index));
+	}
+
+	for (size_t texture_index = 0; texture_index < _textures.size(); ++texture_index)
+	{
+		const texture &tex = _textures[texture_index];
+
+		_effect_name_index.textures[tex.name].push_back(texture_index);
+		if (tex.unique_name != tex.name)
+			_effect_name_index.textures[tex.unique_name].push_back(texture_index);
+	}
+
+	for (size_t technique_index = 0; technique_index < _techniques.size(); ++technique_index)
+		_effect_name_index.techniques[_techniques[technique_index].name].push_back(technique_index);
 }
-bool reshade::runtime::save_effect_cache(const std::string &id, const std::string &type, const std::string &data) const
+
+bool reshade::runtime::load_effect_cache(const std::string &id, const std::string &type, std::string &data) const
 {
 	if (_no_effect_cache)
 		return false;
 
-	std::filesystem::path path = g_reshade_base_path / _effect_cache_path;
-	path /= std::filesystem::u8path("reshade-" + id + '.' + type);
-
-	FILE *const file = _wfsopen(path.c_str(), L"wb", SH_DENYNO);
-	if (file == nullptr)
+	return effect_cache::load_cache(g_reshade_base_path / _effect_cache_path / L"ReShadeEffectCache.bin").load(id + '.' + type, data);
+}
+bool reshade::runtime::save_effect_cache(const std::string &id, const std::string &type, const std::string &data) const
+{
+	if (_no_effect_cache)
 		return false;
 
-	const size_t file_size_written = fwrite(data.data(), 1, data.size(), file);
-	fclose(file);
-	return file_size_written == data.size();
+	effect_cache::load_cache(g_reshade_base_path / _effect_cache_path / L"ReShadeEffectCache.bin").save(id + '.' + type, data);
+	return true;
 }
 void reshade::runtime::clear_effect_cache()
 {
+	if (!effect_cache::load_cache(g_reshade_base_path / _effect_cache_path / L"ReShadeEffectCache.bin").clear())
+		log::message(log::level::error, "Failed to delete effect cache archive in '%s'!", _effect_cache_path.u8string().c_str());
+
 	std::error_code ec;
 
-	// Find all cached effect files and delete them
+	// Find all cached effect files of older versions (which stored each entry in a separate file) and delete them
 	for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(g_reshade_base_path / _effect_cache_path, std::filesystem::directory_options::skip_permission_denied, ec))
 	{
 		if (entry.is_directory(ec))
@@ -3697,9 +4041,12 @@ void reshade::runtime::update_effects()
 
 				_reload_remaining_effects += 1;
 
-				_worker_threads.emplace_back([this, effect_index, permutation_index]() {
+				std::error_code ec;
+				const uintmax_t file_size = std::filesystem::file_size(_effects[effect_index].source_file, ec);
+
+				submit_effect_load_task([this, effect_index, permutation_index]() {
 						load_effect(_effects[effect_index].source_file, ini_file::load_cache(_current_preset_path), effect_index, permutation_index, true);
-					});
+					}, ec ? 0 : static_cast<uint64_t>(file_size));
 			}
 
 			// Force immediate effect initialization of this permutation after reloading
@@ -3713,11 +4060,20 @@ void reshade::runtime::update_effects()
 
 	if (_reload_remaining_effects == 0)
 	{
-		// Clear the thread list now that they all have finished
-		for (std::thread &thread : _worker_threads)
-			if (thread.joinable())
-				thread.join(); // Threads have exited, but still need to join them prior to destruction
-		_worker_threads.clear();
+		// All load tasks have decremented the remaining count, but may still be in the process of returning, so wait for them to fully finish
+		// Only wait for those, not the entire worker pool, which may also be busy with other background work that has nothing to do with effects
+		wait_for_effect_load_tasks();
+
+		update_effect_name_index();
+
+		// Write any new effect cache entries to disk in the background
+		if (!_no_effect_cache)
+		{
+			effect_cache &cache = effect_cache::load_cache(g_reshade_base_path / _effect_cache_path / L"ReShadeEffectCache.bin");
+			cache.set_size_limit(static_cast<uint64_t>(_effect_cache_size_limit) * 1024 * 1024);
+
+			_worker_pool.submit([&cache]() { cache.flush(); });
+		}
 
 		// Finished loading effects, so apply preset to figure out which ones need compiling
 		load_current_preset();
@@ -3827,9 +4183,12 @@ void reshade::runtime::render_effects(api::command_list *cmd_list, api::resource
 		if (!effect.rendering || (!_effects_enabled && !effect.addon))
 			continue;
 
-		for (uniform &variable : effect.uniforms)
+		// Only need to go through the variables that actually have a special source, with all their annotations already resolved
+		for (const special_uniform_info &info : effect.special_uniforms)
 		{
-			switch (variable.special)
+			uniform &variable = effect.uniforms[info.uniform_index];
+
+			switch (info.source)
 			{
 			case special_uniform::frame_time:
 				set_uniform_value(variable, _last_frame_duration.count() * 1e-6f);
@@ -3841,20 +4200,14 @@ void reshade::runtime::render_effects(api::command_list *cmd_list, api::resource
 					set_uniform_value(variable, static_cast<unsigned int>(_frame_count % UINT_MAX));
 				break;
 			case special_uniform::random:
-				{
-					const int min = variable.annotation_as_int("min", 0, 0);
-					const int max = variable.annotation_as_int("max", 0, RAND_MAX);
-					set_uniform_value(variable, min + (std::rand() % (std::abs(max - min) + 1)));
-				}
+				set_uniform_value(variable, info.int_min + (std::rand() % (std::abs(info.int_max - info.int_min) + 1)));
 				break;
 			case special_uniform::ping_pong:
 				{
-					const float min = variable.annotation_as_float("min", 0, 0.0f);
-					const float max = variable.annotation_as_float("max", 0, 1.0f);
-					const float step_min = variable.annotation_as_float("step", 0);
-					const float step_max = variable.annotation_as_float("step", 1);
-					float increment = step_max == 0 ? step_min : (step_min + std::fmod(static_cast<float>(std::rand()), step_max - step_min + 1));
-					const float smoothing = variable.annotation_as_float("smoothing");
+					const float min = info.float_min;
+					const float max = info.float_max;
+					const float smoothing = info.smoothing;
+					float increment = info.step_max == 0 ? info.step_min : (info.step_min + std::fmod(static_cast<float>(std::rand()), info.step_max - info.step_min + 1));
 
 					float value[2] = { 0, 0 };
 					get_uniform_value(variable, value, 2);
@@ -3900,19 +4253,18 @@ void reshade::runtime::render_effects(api::command_list *cmd_list, api::resource
 			case special_uniform::key:
 				if (_input != nullptr)
 				{
-					const int keycode = variable.annotation_as_int("keycode");
+					const int keycode = info.keycode;
 					if (keycode <= 7 || keycode >= 256)
 						break;
 
-					const std::string_view mode = variable.annotation_as_string("mode");
-					if (mode == "toggle" || variable.annotation_as_int("toggle"))
+					if (info.mode == special_uniform_info::input_mode::toggle)
 					{
 						bool current_value = false;
 						get_uniform_value(variable, &current_value);
 						if (_input->is_key_pressed(keycode))
 							set_uniform_value(variable, !current_value);
 					}
-					else if (mode == "press")
+					else if (info.mode == special_uniform_info::input_mode::press)
 						set_uniform_value(variable, _input->is_key_pressed(keycode));
 					else
 						set_uniform_value(variable, _input->is_key_down(keycode));
@@ -3929,19 +4281,18 @@ void reshade::runtime::render_effects(api::command_list *cmd_list, api::resource
 			case special_uniform::mouse_button:
 				if (_input != nullptr)
 				{
-					const int keycode = variable.annotation_as_int("keycode");
+					const int keycode = info.keycode;
 					if (keycode < 0 || keycode >= 5)
 						break;
 
-					const std::string_view mode = variable.annotation_as_string("mode");
-					if (mode == "toggle" || variable.annotation_as_int("toggle"))
+					if (info.mode == special_uniform_info::input_mode::toggle)
 					{
 						bool current_value = false;
 						get_uniform_value(variable, &current_value);
 						if (_input->is_mouse_button_pressed(keycode))
 							set_uniform_value(variable, !current_value);
 					}
-					else if (mode == "press")
+					else if (info.mode == special_uniform_info::input_mode::press)
 						set_uniform_value(variable, _input->is_mouse_button_pressed(keycode));
 					else
 						set_uniform_value(variable, _input->is_mouse_button_down(keycode));
@@ -3950,20 +4301,14 @@ void reshade::runtime::render_effects(api::command_list *cmd_list, api::resource
 			case special_uniform::mouse_wheel:
 				if (_input != nullptr)
 				{
-					const float min = variable.annotation_as_float("min");
-					const float max = variable.annotation_as_float("max");
-					float step = variable.annotation_as_float("step");
-					if (step == 0.0f)
-						step = 1.0f;
-
 					float value[2] = { 0, 0 };
 					get_uniform_value(variable, value, 2);
 					value[1] = _input->mouse_wheel_delta();
-					value[0] = value[0] + value[1] * step;
-					if (min != max)
+					value[0] = value[0] + value[1] * info.step_min;
+					if (info.float_min != info.float_max)
 					{
-						value[0] = std::max(value[0], min);
-						value[0] = std::min(value[0], max);
+						value[0] = std::max(value[0], info.float_min);
+						value[0] = std::min(value[0], info.float_max);
 					}
 					set_uniform_value(variable, value, 2);
 				}
@@ -4024,6 +4369,12 @@ void reshade::runtime::render_effects(api::command_list *cmd_list, api::resource
 	cmd_list->begin_debug_event("ReShade effects");
 #endif
 
+	// Keep track of whether the effect color texture still contains the current back buffer contents, so that techniques which do not write to the back buffer do not cause redundant copies
+	bool color_tex_up_to_date = false;
+
+	// Resource transitions are deferred across passes and techniques, so that they can be batched and redundant ones skipped
+	resource_state_tracker state_tracker;
+
 	// Render all enabled techniques
 	for (size_t technique_index : _technique_sorting)
 	{
@@ -4042,7 +4393,13 @@ void reshade::runtime::render_effects(api::command_list *cmd_list, api::resource
 			continue;
 		}
 
-		render_technique(tech, cmd_list, back_buffer_resource, rtv, rtv_srgb, permutation_index);
+		render_technique(tech, cmd_list, back_buffer_resource, rtv, rtv_srgb, permutation_index, color_tex_up_to_date, state_tracker);
+
+#if RESHADE_ADDON
+		// Add-ons may have modified the back buffer after the technique was rendered
+		if (has_addon_event<addon_event::reshade_render_technique>())
+			color_tex_up_to_date = false;
+#endif
 
 		if (tech.time_left > 0)
 		{
@@ -4052,6 +4409,10 @@ void reshade::runtime::render_effects(api::command_list *cmd_list, api::resource
 		}
 	}
 
+	// Transition all resources back to their default state
+	state_tracker.restore();
+	state_tracker.flush(cmd_list);
+
 #ifndef NDEBUG
 	cmd_list->end_debug_event();
 #endif
@@ -4063,9 +4424,9 @@ void reshade::runtime::render_effects(api::command_list *cmd_list, api::resource
 		api::apply_state(cmd_list, _app_state);
 #endif
 }
-void reshade::runtime::render_technique(technique &tech, api::command_list *cmd_list, api::resource back_buffer_resource, api::resource_view back_buffer_rtv, api::resource_view back_buffer_rtv_srgb, size_t permutation_index)
+void reshade::runtime::render_technique(technique &tech, api::command_list *cmd_list, api::resource back_buffer_resource, api::resource_view back_buffer_rtv, api::resource_view back_buffer_rtv_srgb, size_t permutation_index, bool &color_tex_up_to_date, resource_state_tracker &state_tracker)
 {
-	const effect &effect = _effects[tech.effect_index];
+	effect &effect = _effects[tech.effect_index];
 	const effect::permutation &permutation = effect.permutations[permutation_index];
 
 #ifndef NDEBUG
@@ -4101,12 +4462,28 @@ void reshade::runtime::render_technique(technique &tech, api::command_list *cmd_
 	const std::chrono::high_resolution_clock::time_point time_technique_started = std::chrono::high_resolution_clock::now();
 #endif
 
-	// Update shader constants
-	if (void *mapped_uniform_data;
-		effect.cb != 0 && _device->map_buffer_region(effect.cb, 0, effect.uniform_data_storage.size(), api::map_access::write_discard, &mapped_uniform_data))
+	// Update shader constants (the constant buffer retains its contents, so only need to do this when any values changed since the last upload)
+	if (effect.cb != 0)
 	{
-		std::memcpy(mapped_uniform_data, effect.uniform_data_storage.data(), effect.uniform_data_storage.size());
-		_device->unmap_buffer_region(effect.cb);
+		// Clamp to the storage size, which is also the size of the constant buffer, so that this never reads or writes past their end
+		const size_t dirty_end = std::min(effect.uniform_data_dirty_end, effect.uniform_data_storage.size());
+
+		if (effect.uniform_data_dirty_begin < dirty_end)
+		{
+			// D3D10 and D3D11 require discarding and rewriting the entire buffer, other APIs can update just the modified range
+			const bool discard = _device->get_api() == api::device_api::d3d10 || _device->get_api() == api::device_api::d3d11;
+			const size_t offset = discard ? 0 : effect.uniform_data_dirty_begin;
+			const size_t size = discard ? effect.uniform_data_storage.size() : dirty_end - effect.uniform_data_dirty_begin;
+
+			if (void *mapped_uniform_data;
+				_device->map_buffer_region(effect.cb, offset, size, discard ? api::map_access::write_discard : api::map_access::write_only, &mapped_uniform_data))
+			{
+				std::memcpy(mapped_uniform_data, effect.uniform_data_storage.data() + offset, size);
+				_device->unmap_buffer_region(effect.cb);
+
+				effect.clear_uniform_data_dirty();
+			}
+		}
 	}
 	else if (_device->get_api() == api::device_api::d3d9)
 	{
@@ -4116,23 +4493,23 @@ void reshade::runtime::render_technique(technique &tech, api::command_list *cmd_
 	const bool sampler_with_resource_view = _device->check_capability(api::device_caps::sampler_with_resource_view);
 
 	bool is_effect_stencil_cleared = false;
-	bool needs_implicit_back_buffer_copy = true; // First pass always needs the back buffer updated
 
 	for (size_t pass_index = 0; pass_index < tech.permutations[permutation_index].passes.size(); ++pass_index)
 	{
-		if (needs_implicit_back_buffer_copy)
+		const technique::pass &pass = tech.permutations[permutation_index].passes[pass_index];
+
+		// Only need to update the effect color texture if this pass actually samples it and the back buffer was modified since the last copy
+		if (pass.samples_back_buffer && !color_tex_up_to_date)
 		{
-			// Save back buffer of previous pass
-			const api::resource resources[2] = { back_buffer_resource, _effect_permutations[permutation_index].color_tex};
-			const api::resource_usage state_old[2] = { api::resource_usage::render_target, api::resource_usage::shader_resource };
-			const api::resource_usage state_new[2] = { api::resource_usage::copy_source, api::resource_usage::copy_dest };
+			// Save back buffer of previous pass (resources are transitioned back to their default state together with the barriers of the pass below)
+			state_tracker.transition(back_buffer_resource, api::resource_usage::render_target, api::resource_usage::copy_source);
+			state_tracker.transition(_effect_permutations[permutation_index].color_tex, api::resource_usage::shader_resource, api::resource_usage::copy_dest);
+			state_tracker.flush(cmd_list);
 
-			cmd_list->barrier(2, resources, state_old, state_new);
 			cmd_list->copy_texture_region(back_buffer_resource, 0, nullptr, _effect_permutations[permutation_index].color_tex, 0, nullptr);
-			cmd_list->barrier(2, resources, state_new, state_old);
-		}
 
-		const technique::pass &pass = tech.permutations[permutation_index].passes[pass_index];
+			color_tex_up_to_date = true;
+		}
 
 #ifndef NDEBUG
 		cmd_list->begin_debug_event((pass.name.empty() ? "Pass " + std::to_string(pass_index) : pass.name).c_str());
@@ -4143,19 +4520,16 @@ void reshade::runtime::render_technique(technique &tech, api::command_list *cmd_
 			cmd_list->end_query(effect.query_heap, api::query_type::timestamp, query_base_index + static_cast<uint32_t>((1 + pass_index) * 2));
 #endif
 
-		const uint32_t num_barriers = static_cast<uint32_t>(pass.modified_resources.size());
+		// Transition resources modified by previous passes back to shader access, unless this pass modifies them too
+		state_tracker.restore(pass.modified_resources.size(), pass.modified_resources.data());
 
 		if (!pass.cs_entry_point.empty())
 		{
-			// Compute shaders do not write to the back buffer, so no update necessary
-			needs_implicit_back_buffer_copy = false;
-
 			cmd_list->bind_pipeline(api::pipeline_stage::all_compute, pass.pipeline);
 
-			temp_mem<api::resource_usage> state_old, state_new;
-			std::fill_n(state_old.p, num_barriers, api::resource_usage::shader_resource);
-			std::fill_n(state_new.p, num_barriers, api::resource_usage::unordered_access);
-			cmd_list->barrier(num_barriers, pass.modified_resources.data(), state_old.p, state_new.p);
+			for (const api::resource modified_resource : pass.modified_resources)
+				state_tracker.transition(modified_resource, api::resource_usage::shader_resource, api::resource_usage::unordered_access);
+			state_tracker.flush(cmd_list);
 
 			// Reset bindings on every pass (since they get invalidated by the call to 'generate_mipmaps' below)
 			if (effect.cb != 0)
@@ -4169,18 +4543,15 @@ void reshade::runtime::render_technique(technique &tech, api::command_list *cmd_
 				cmd_list->bind_descriptor_table(api::shader_stage::all_compute, permutation.layout, sampler_with_resource_view ? 2 : 3, pass.storage_table);
 
 			cmd_list->dispatch(pass.viewport_width, pass.viewport_height, pass.viewport_dispatch_z);
-
-			cmd_list->barrier(num_barriers, pass.modified_resources.data(), state_new.p, state_old.p);
 		}
 		else
 		{
 			cmd_list->bind_pipeline(api::pipeline_stage::all_graphics, pass.pipeline);
 
 			// Transition resource state for render targets
-			temp_mem<api::resource_usage> state_old, state_new;
-			std::fill_n(state_old.p, num_barriers, api::resource_usage::shader_resource);
-			std::fill_n(state_new.p, num_barriers, api::resource_usage::render_target);
-			cmd_list->barrier(num_barriers, pass.modified_resources.data(), state_old.p, state_new.p);
+			for (const api::resource modified_resource : pass.modified_resources)
+				state_tracker.transition(modified_resource, api::resource_usage::shader_resource, api::resource_usage::render_target);
+			state_tracker.flush(cmd_list);
 
 			// Setup render targets
 			uint32_t render_target_count = 0;
@@ -4189,15 +4560,14 @@ void reshade::runtime::render_technique(technique &tech, api::command_list *cmd_
 
 			if (pass.render_target_names[0].empty())
 			{
-				needs_implicit_back_buffer_copy = true;
+				// Pass writes to the back buffer, so the effect color texture is outdated afterwards
+				color_tex_up_to_date = false;
 
 				render_target[0].view = pass.srgb_write_enable ? back_buffer_rtv_srgb : back_buffer_rtv;
 				render_target_count = 1;
 			}
 			else
 			{
-				needs_implicit_back_buffer_copy = false;
-
 				for (int i = 0; i < 8 && pass.render_target_views[i] != 0; ++i, ++render_target_count)
 					render_target[i].view = pass.render_target_views[i];
 			}
@@ -4288,9 +4658,6 @@ void reshade::runtime::render_technique(technique &tech, api::command_list *cmd_
 			cmd_list->draw(pass.num_vertices, 1, 0, 0);
 
 			cmd_list->end_render_pass();
-
-			// Transition resource state back to shader access
-			cmd_list->barrier(num_barriers, pass.modified_resources.data(), state_new.p, state_old.p);
 		}
 
 #if RESHADE_GUI
@@ -4302,9 +4669,15 @@ void reshade::runtime::render_technique(technique &tech, api::command_list *cmd_
 		cmd_list->end_debug_event();
 #endif
 
-		// Generate mipmaps for modified resources
-		for (const api::resource_view modified_texture : pass.generate_mipmap_views)
-			cmd_list->generate_mipmaps(modified_texture);
+		// Generate mipmaps for modified resources (which requires them to be in shader access state)
+		if (!pass.generate_mipmap_views.empty())
+		{
+			state_tracker.restore();
+			state_tracker.flush(cmd_list);
+
+			for (const api::resource_view modified_texture : pass.generate_mipmap_views)
+				cmd_list->generate_mipmaps(modified_texture);
+		}
 	}
 
 #if RESHADE_GUI
@@ -4321,6 +4694,13 @@ void reshade::runtime::render_technique(technique &tech, api::command_list *cmd_
 #endif
 
 #if RESHADE_ADDON
+	// Add-ons expect all resources to be in their default state when notified
+	if (has_addon_event<addon_event::reshade_render_technique>())
+	{
+		state_tracker.restore();
+		state_tracker.flush(cmd_list);
+	}
+
 	invoke_addon_event<addon_event::reshade_render_technique>(const_cast<runtime *>(this), api::effect_technique { reinterpret_cast<uintptr_t>(&tech) }, cmd_list, back_buffer_rtv, back_buffer_rtv_srgb);
 #endif
 }
@@ -4359,7 +4739,7 @@ void reshade::runtime::save_texture(const texture &tex)
 	if (std::vector<uint8_t> pixels(static_cast<size_t>(tex.width) * static_cast<size_t>(tex.height) * 4);
 		get_texture_data(tex.resource, api::resource_usage::shader_resource, pixels.data(), api::format::r8g8b8a8_unorm))
 	{
-		_worker_threads.emplace_back([this, screenshot_path, pixels = std::move(pixels), width = tex.width, height = tex.height]() mutable {
+		_worker_pool.submit([this, screenshot_path, pixels = std::move(pixels), width = tex.width, height = tex.height]() mutable {
 			// Default to a save failure unless it is reported to succeed below
 			bool save_success = false;
 
@@ -4406,24 +4786,10 @@ void reshade::runtime::save_texture(const texture &tex)
 						/* big_endian = */ false,
 						/* effort = */ 2,
 						&encoded_data,
-						nullptr,
-						[](void *, void *opaque, void fun(void *, size_t), size_t count) {
-							const size_t num_splits = std::min(count, static_cast<size_t>(std::thread::hardware_concurrency()));
-							if (num_splits == 1)
-							{
-								for (size_t i = 0; i < count; ++i)
-									fun(opaque, i);
-								return;
-							}
-							std::vector<std::thread> worker_threads;
-							for (size_t n = 0; n < num_splits; ++n)
-								worker_threads.emplace_back([count, opaque, fun, num_splits, n]() {
-									for (size_t i = 0; i < count; ++i)
-										if (i * num_splits / count == n)
-											fun(opaque, i);
-								});
-							for (std::thread &thread : worker_threads)
-								thread.join();
+						&_worker_pool,
+						[](void *runner_opaque, void *opaque, void fun(void *, size_t), size_t count) {
+							// Reuse the worker threads of the runtime instead of spawning new ones for every screenshot
+							static_cast<thread_pool *>(runner_opaque)->parallel_for(count, [opaque, fun](size_t i) { fun(opaque, i); });
 						},
 						color_encoding);
 
@@ -4544,7 +4910,9 @@ void reshade::runtime::reset_uniform_value(uniform &variable)
 {
 	if (variable.special != reshade::special_uniform::none)
 	{
-		std::memset(_effects[variable.effect_index].uniform_data_storage.data() + variable.offset, 0, variable.size);
+		effect &effect = _effects[variable.effect_index];
+		std::memset(effect.uniform_data_storage.data() + variable.offset, 0, variable.size);
+		effect.mark_uniform_data_dirty(variable.offset, variable.size);
 		return;
 	}
 
@@ -4680,7 +5048,8 @@ void reshade::runtime::set_uniform_value_data(uniform &variable, const uint8_t *
 	size = std::min(size, static_cast<size_t>(variable.size));
 	assert(data != nullptr && (size % 4) == 0);
 
-	std::vector<uint8_t> &data_storage = _effects[variable.effect_index].uniform_data_storage;
+	effect &effect = _effects[variable.effect_index];
+	std::vector<uint8_t> &data_storage = effect.uniform_data_storage;
 	assert(variable.offset + size <= data_storage.size());
 
 	const size_t array_length = (variable.type.is_array() ? variable.type.array_length : 1u);
@@ -4708,8 +5077,14 @@ void reshade::runtime::set_uniform_value_data(uniform &variable, const uint8_t *
 	}
 	else
 	{
+		// Many variables are set to the same value every frame (e.g. key states), so avoid marking the constant buffer as modified in that case
+		if (std::memcmp(data_storage.data() + variable.offset, data, size) == 0)
+			return;
+
 		std::memcpy(data_storage.data() + variable.offset, data, size);
 	}
+
+	effect.mark_uniform_data_dirty(variable.offset, variable.size);
 }
 
 template <> void reshade::runtime::set_uniform_value<bool>(uniform &variable, const bool *values, size_t count, size_t array_index)
@@ -4843,7 +5218,7 @@ void reshade::runtime::save_screenshot(const char *postfix_in)
 		if (!_screenshot_sound_path.empty())
 			utils::play_sound_async(g_reshade_base_path / _screenshot_sound_path);
 
-		_worker_threads.emplace_back([this, screenshot_count, screenshot_format, screenshot_path, postfix, pixels = std::move(pixels), include_preset]() mutable {
+		_worker_pool.submit([this, screenshot_count, screenshot_format, screenshot_path, postfix, pixels = std::move(pixels), include_preset]() mutable {
 			// Remove alpha channel
 			int comp = 4;
 			if (screenshot_format >= 4)
@@ -4990,24 +5365,10 @@ void reshade::runtime::save_screenshot(const char *postfix_in)
 						/* big_endian = */ false,
 						/* effort = */ 2,
 						&encoded_data,
-						nullptr,
-						[](void *, void *opaque, void fun(void *, size_t), size_t count) {
-							const size_t num_splits = std::min(count, static_cast<size_t>(std::thread::hardware_concurrency()));
-							if (num_splits == 1)
-							{
-								for (size_t i = 0; i < count; ++i)
-									fun(opaque, i);
-								return;
-							}
-							std::vector<std::thread> worker_threads;
-							for (size_t n = 0; n < num_splits; ++n)
-								worker_threads.emplace_back([count, opaque, fun, num_splits, n]() {
-									for (size_t i = 0; i < count; ++i)
-										if (i * num_splits / count == n)
-											fun(opaque, i);
-								});
-							for (std::thread &thread : worker_threads)
-								thread.join();
+						&_worker_pool,
+						[](void *runner_opaque, void *opaque, void fun(void *, size_t), size_t count) {
+							// Reuse the worker threads of the runtime instead of spawning new ones for every screenshot
+							static_cast<thread_pool *>(runner_opaque)->parallel_for(count, [opaque, fun](size_t i) { fun(opaque, i); });
 						},
 						color_encoding);
 
@@ -8,6 +8,7 @@
 #include "reshade_api.hpp"
 #include "state_block.hpp"
 #include "imgui_code_editor.hpp"
+#include "thread_pool.hpp"
 #include <atomic>
 #include <thread>
 #include <chrono>
@@ -15,6 +16,7 @@
 #include <filesystem>
 #include <mutex>
 #include <shared_mutex>
+#include <algorithm>
 
 namespace reshade
 {
@@ -22,6 +24,7 @@ namespace reshade
 	struct uniform;
 	struct texture;
 	struct technique;
+	class resource_state_tracker;
 
 	/// <summary>
 	/// The main ReShade post-processing effect runtime.
@@ -198,6 +201,10 @@ namespace reshade
 		bool reload_effect(size_t effect_index);
 		void reload_effects(bool force_load_all = false);
 		void destroy_effects();
+		void update_effect_name_index();
+
+		void submit_effect_load_task(std::function<void()> task, uint64_t cost);
+		void wait_for_effect_load_tasks();
 
 		bool load_effect_cache(const std::string &id, const std::string &type, std::string &data) const;
 		bool save_effect_cache(const std::string &id, const std::string &type, const std::string &data) const;
@@ -206,7 +213,7 @@ namespace reshade
 		auto add_effect_permutation(uint32_t width, uint32_t height, api::format color_format, api::format stencil_format, api::color_space color_space) -> size_t;
 
 		void update_effects();
-		void render_technique(technique &technique, api::command_list *cmd_list, api::resource back_buffer_resource, api::resource_view back_buffer_rtv, api::resource_view back_buffer_rtv_srgb, size_t permutation_index);
+		void render_technique(technique &technique, api::command_list *cmd_list, api::resource back_buffer_resource, api::resource_view back_buffer_rtv, api::resource_view back_buffer_rtv_srgb, size_t permutation_index, bool &color_tex_up_to_date, resource_state_tracker &state_tracker);
 
 		void save_texture(const texture &texture);
 		void update_texture(texture &texture, uint32_t width, uint32_t height, uint32_t depth, const void *pixels);
@@ -290,6 +297,7 @@ namespace reshade
 		std::vector<std::pair<size_t, size_t>> _reload_required_effects;
 
 		std::filesystem::path _effect_cache_path;
+		unsigned int _effect_cache_size_limit = 256; // In MiB
 		std::vector<std::filesystem::path> _effect_search_paths;
 		std::vector<std::filesystem::path> _texture_search_paths;
 
@@ -303,7 +311,34 @@ namespace reshade
 		std::vector<technique> _techniques;
 		std::vector<size_t> _technique_sorting;
 
-		std::vector<std::thread> _worker_threads;
+		/// <summary>
+		/// Name lookup tables used by the add-on API, rebuilt whenever effects finished loading, so that finding a variable or technique is a hash lookup instead of a search through all effects.
+		/// </summary>
+		struct effect_name_index
+		{
+			// File name of each effect (UTF-8), by effect index
+			std::vector<std::string> effect_file_names;
+			// First effect with a given file name
+			std::unordered_map<std::string, size_t> effects;
+			// First uniform variable with a given name across all effects, as pair of effect index and index into its uniforms
+			std::unordered_map<std::string, std::pair<size_t, size_t>> uniforms;
+			// Indices of all textures with a given name or unique name, in ascending order
+			std::unordered_map<std::string, std::vector<size_t>> textures;
+			// Indices of all techniques with a given name, in ascending order
+			std::unordered_map<std::string, std::vector<size_t>> techniques;
+		};
+		effect_name_index _effect_name_index;
+
+#ifndef _WIN64
+		// Limit number of threads in 32-bit due to the limited about of address space being available there and compilation being memory hungry
+		thread_pool _worker_pool { std::min(static_cast<size_t>(std::max(std::thread::hardware_concurrency(), 2u) - 1), static_cast<size_t>(4)) };
+#else
+		thread_pool _worker_pool;
+#endif
+		// Number of effect load tasks on the worker pool that have not returned yet, which is tracked separately so that waiting for them does not also wait for unrelated background work (like INI file writes)
+		size_t _reload_tasks_running = 0;
+		std::mutex _reload_tasks_mutex;
+		std::condition_variable _reload_tasks_finished;
 		std::chrono::high_resolution_clock::time_point _last_reload_time;
 		#pragma endregion
 
@@ -377,12 +412,77 @@ namespace reshade
 		bool _is_in_preset_transition = false;
 		std::chrono::high_resolution_clock::time_point _last_preset_switching_time;
 
+		/// <summary>
+		/// Floating-point uniform values to blend between during a preset transition.
+		/// These are resolved from the preset once, so that the remaining frames of the transition do not have to load it again.
+		/// </summary>
+		struct preset_transition_plan
+		{
+			struct target
+			{
+				size_t effect_index;
+				size_t uniform_index;
+				size_t value_index;
+				size_t value_count;
+			};
+
+			// Switching time and preset path of the transition this plan was created for
+			std::chrono::high_resolution_clock::time_point switching_time;
+			std::filesystem::path preset_path;
+			// Time since the start of the transition when this plan was created, in microseconds
+			int64_t start_time = 0;
+			std::vector<target> targets;
+			std::vector<float> start_values;
+			std::vector<float> end_values;
+			std::vector<float> values;
+		};
+		preset_transition_plan _preset_transition_plan;
+
 		struct preset_shortcut
 		{
 			std::filesystem::path preset_path;
 			unsigned int key_data[4] = {};
 		};
 		std::vector<preset_shortcut> _preset_shortcuts;
+
+		/// <summary>
+		/// Preset files found for a filter path passed to <see cref="switch_to_next_preset"/>, so that switching does not have to search and parse them again on every key press.
+		/// </summary>
+		struct preset_catalog
+		{
+			struct entry
+			{
+				std::filesystem::path path;
+				std::filesystem::file_time_type modified_at;
+				uintmax_t size = 0;
+				bool valid = false;
+				// Key of this entry in 'entry_indices'
+				std::filesystem::path::string_type key;
+				// Technique list of the preset file, as it was on disk when the entry was last parsed
+				std::vector<std::string> techniques;
+			};
+
+			// Set if the filter path is a single preset file instead of a directory
+			std::filesystem::path single_preset_path;
+			// All preset file candidates in the directory, in directory iteration order
+			std::vector<entry> entries;
+			// Indices of the entries by canonical and case-folded path (see 'make_preset_catalog_key'), so that differently spelled paths to the same file find the same entry
+			std::unordered_map<std::filesystem::path::string_type, size_t> entry_indices;
+			// Indices of the valid entries whose name contains the filter text, in ascending order
+			std::vector<size_t> matching_entries;
+			std::chrono::steady_clock::time_point refreshed_at;
+			bool refresh_scheduled = false;
+		};
+
+		static std::shared_ptr<preset_catalog> build_preset_catalog(std::filesystem::path filter_path, const preset_catalog *previous_catalog);
+
+		void update_current_preset_catalog_key();
+
+		std::mutex _preset_catalog_mutex;
+		std::unordered_map<std::filesystem::path::string_type, std::shared_ptr<preset_catalog>> _preset_catalogs;
+		// Catalog key of the current preset and the preset path it was built from, so that it only has to be rebuilt when the current preset changes
+		std::filesystem::path _current_preset_catalog_key_path;
+		std::filesystem::path::string_type _current_preset_catalog_key;
 		#pragma endregion
 
 #if RESHADE_GUI
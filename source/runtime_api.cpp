@@ -89,22 +89,25 @@ reshade::api::effect_uniform_variable reshade::runtime::find_uniform_variable(co
 	if (is_loading() || variable_name_in == nullptr)
 		return { 0 };
 
-	const std::filesystem::path effect_name = effect_name_in != nullptr ? std::filesystem::u8path(effect_name_in) : std::filesystem::path();
-	const std::string_view variable_name(variable_name_in);
+	const std::string variable_name(variable_name_in);
 
-	for (const effect &effect : _effects)
+	if (effect_name_in != nullptr)
 	{
-		if (effect_name_in != nullptr && effect.source_file.filename() != effect_name)
-			continue;
-
-		for (const uniform &variable : effect.uniforms)
+		if (const auto effect_it = _effect_name_index.effects.find(effect_name_in);
+			effect_it != _effect_name_index.effects.end())
 		{
-			if (variable.name == variable_name)
-				return { reinterpret_cast<uintptr_t>(&variable) };
-		}
+			const effect &effect = _effects[effect_it->second];
 
-		if (effect_name_in != nullptr)
-			break;
+			if (const auto it = effect.uniform_indices.find(variable_name);
+				it != effect.uniform_indices.end())
+				return { reinterpret_cast<uintptr_t>(&effect.uniforms[it->second]) };
+		}
+	}
+	else
+	{
+		if (const auto it = _effect_name_index.uniforms.find(variable_name);
+			it != _effect_name_index.uniforms.end())
+			return { reinterpret_cast<uintptr_t>(&_effects[it->second.first].uniforms[it->second.second]) };
 	}
 
 	return { 0 };
@@ -218,12 +221,10 @@ bool reshade::runtime::get_annotation_bool_from_uniform_variable(api::effect_uni
 		const uniform &variable = *reinterpret_cast<const uniform *>(handle.handle);
 		const std::string_view name(name_in);
 
-		if (const auto it = std::find_if(variable.annotations.cbegin(), variable.annotations.cend(),
-				[&](const reshadefx::annotation &annotation) { return annotation.name == name; });
-			it != variable.annotations.cend())
+		if (const reshadefx::annotation *const annotation = find_annotation(variable.annotations, name))
 		{
 			for (size_t i = 0; i < count; ++i)
-				values[i] = variable.annotation_as_int(name, i + array_index) != 0;
+				values[i] = annotation_value_as_int(*annotation, i + array_index) != 0;
 			return true;
 		}
 	}
@@ -239,12 +240,10 @@ bool reshade::runtime::get_annotation_float_from_uniform_variable(api::effect_un
 		const uniform &variable = *reinterpret_cast<const uniform *>(handle.handle);
 		const std::string_view name(name_in);
 
-		if (const auto it = std::find_if(variable.annotations.cbegin(), variable.annotations.cend(),
-				[&](const reshadefx::annotation &annotation) { return annotation.name == name; });
-			it != variable.annotations.cend())
+		if (const reshadefx::annotation *const annotation = find_annotation(variable.annotations, name))
 		{
 			for (size_t i = 0; i < count; ++i)
-				values[i] = variable.annotation_as_float(name, i + array_index);
+				values[i] = annotation_value_as_float(*annotation, i + array_index);
 			return true;
 		}
 	}
@@ -260,12 +259,10 @@ bool reshade::runtime::get_annotation_int_from_uniform_variable(api::effect_unif
 		const uniform &variable = *reinterpret_cast<const uniform *>(handle.handle);
 		const std::string_view name(name_in);
 
-		if (const auto it = std::find_if(variable.annotations.cbegin(), variable.annotations.cend(),
-				[&](const reshadefx::annotation &annotation) { return annotation.name == name; });
-			it != variable.annotations.cend())
+		if (const reshadefx::annotation *const annotation = find_annotation(variable.annotations, name))
 		{
 			for (size_t i = 0; i < count; ++i)
-				values[i] = variable.annotation_as_int(name, array_index + i);
+				values[i] = annotation_value_as_int(*annotation, array_index + i);
 			return true;
 		}
 	}
@@ -281,12 +278,10 @@ bool reshade::runtime::get_annotation_uint_from_uniform_variable(api::effect_uni
 		const uniform &variable = *reinterpret_cast<const uniform *>(handle.handle);
 		const std::string_view name(name_in);
 
-		if (const auto it = std::find_if(variable.annotations.cbegin(), variable.annotations.cend(),
-				[&](const reshadefx::annotation &annotation) { return annotation.name == name; });
-			it != variable.annotations.cend())
+		if (const reshadefx::annotation *const annotation = find_annotation(variable.annotations, name))
 		{
 			for (size_t i = 0; i < count; ++i)
-				values[i] = variable.annotation_as_uint(name, array_index + i);
+				values[i] = annotation_value_as_uint(*annotation, array_index + i);
 			return true;
 		}
 	}
@@ -302,21 +297,19 @@ bool reshade::runtime::get_annotation_string_from_uniform_variable(api::effect_u
 		const uniform &variable = *reinterpret_cast<const uniform *>(handle.handle);
 		const std::string_view name(name_in);
 
-		if (const auto it = std::find_if(variable.annotations.cbegin(), variable.annotations.cend(),
-				[&](const reshadefx::annotation &annotation) { return annotation.name == name; });
-			it != variable.annotations.cend())
+		if (const reshadefx::annotation *const annotation = find_annotation(variable.annotations, name))
 		{
-			const std::string_view annotation = variable.annotation_as_string(name);
+			const std::string_view value_string(annotation->value.string_data);
 
 			if (size != nullptr)
 			{
 				if (value == nullptr)
 				{
-					*size = annotation.size() + 1;
+					*size = value_string.size() + 1;
 				}
 				else if (*size != 0)
 				{
-					*size = annotation.copy(value, *size - 1);
+					*size = value_string.copy(value, *size - 1);
 					value[*size] = '\0';
 				}
 			}
@@ -442,21 +435,23 @@ reshade::api::effect_texture_variable reshade::runtime::find_texture_variable(co
 	if (is_loading() || variable_name_in == nullptr)
 		return { 0 };
 
-	const std::filesystem::path effect_name = effect_name_in != nullptr ? std::filesystem::u8path(effect_name_in) : std::filesystem::path();
-	const std::string_view variable_name(variable_name_in);
+	const auto it = _effect_name_index.textures.find(variable_name_in);
+	if (it == _effect_name_index.textures.end())
+		return { 0 };
 
-	for (const texture &variable : _textures)
+	const std::string_view effect_name = effect_name_in != nullptr ? std::string_view(effect_name_in) : std::string_view();
+
+	for (const size_t texture_index : it->second)
 	{
+		const texture &variable = _textures[texture_index];
+
 		if (effect_name_in != nullptr &&
 			std::find_if(variable.shared.cbegin(), variable.shared.cend(),
 				[&](size_t effect_index) {
-					return _effects[effect_index].source_file.filename() == effect_name;
+					return _effect_name_index.effect_file_names[effect_index] == effect_name;
 				}) == variable.shared.cend())
 			continue;
 
-		if (variable.name != variable_name && variable.unique_name != variable_name)
-			continue;
-
 		return { reinterpret_cast<uintptr_t>(&variable) };
 	}
 
@@ -518,12 +513,10 @@ bool reshade::runtime::get_annotation_bool_from_texture_variable(api::effect_tex
 		const texture &variable = *reinterpret_cast<const texture *>(handle.handle);
 		const std::string_view name(name_in);
 
-		if (const auto it = std::find_if(variable.annotations.cbegin(), variable.annotations.cend(),
-				[&](const reshadefx::annotation &annotation) { return annotation.name == name; });
-			it != variable.annotations.cend())
+		if (const reshadefx::annotation *const annotation = find_annotation(variable.annotations, name))
 		{
 			for (size_t i = 0; i < count; ++i)
-				values[i] = variable.annotation_as_int(name, array_index + i) != 0;
+				values[i] = annotation_value_as_int(*annotation, array_index + i) != 0;
 			return true;
 		}
 	}
@@ -539,12 +532,10 @@ bool reshade::runtime::get_annotation_float_from_texture_variable(api::effect_te
 		const texture &variable = *reinterpret_cast<const texture *>(handle.handle);
 		const std::string_view name(name_in);
 
-		if (const auto it = std::find_if(variable.annotations.cbegin(), variable.annotations.cend(),
-				[&](const reshadefx::annotation &annotation) { return annotation.name == name; });
-			it != variable.annotations.cend())
+		if (const reshadefx::annotation *const annotation = find_annotation(variable.annotations, name))
 		{
 			for (size_t i = 0; i < count; ++i)
-				values[i] = variable.annotation_as_float(name, array_index + i);
+				values[i] = annotation_value_as_float(*annotation, array_index + i);
 			return true;
 		}
 	}
@@ -560,12 +551,10 @@ bool reshade::runtime::get_annotation_int_from_texture_variable(api::effect_text
 		const texture &variable = *reinterpret_cast<const texture *>(handle.handle);
 		const std::string_view name(name_in);
 
-		if (const auto it = std::find_if(variable.annotations.cbegin(), variable.annotations.cend(),
-				[&](const reshadefx::annotation &annotation) { return annotation.name == name; });
-			it != variable.annotations.cend())
+		if (const reshadefx::annotation *const annotation = find_annotation(variable.annotations, name))
 		{
 			for (size_t i = 0; i < count; ++i)
-				values[i] = variable.annotation_as_int(name, array_index + i);
+				values[i] = annotation_value_as_int(*annotation, array_index + i);
 			return true;
 		}
 	}
@@ -581,12 +570,10 @@ bool reshade::runtime::get_annotation_uint_from_texture_variable(api::effect_tex
 		const texture &variable = *reinterpret_cast<const texture *>(handle.handle);
 		const std::string_view name(name_in);
 
-		if (const auto it = std::find_if(variable.annotations.cbegin(), variable.annotations.cend(),
-				[&](const reshadefx::annotation &annotation) { return annotation.name == name; });
-			it != variable.annotations.cend())
+		if (const reshadefx::annotation *const annotation = find_annotation(variable.annotations, name))
 		{
 			for (size_t i = 0; i < count; ++i)
-				values[i] = variable.annotation_as_uint(name, array_index + i);
+				values[i] = annotation_value_as_uint(*annotation, array_index + i);
 			return true;
 		}
 	}
@@ -602,21 +589,19 @@ bool reshade::runtime::get_annotation_string_from_texture_variable(api::effect_t
 		const texture &variable = *reinterpret_cast<const texture *>(handle.handle);
 		const std::string_view name(name_in);
 
-		if (const auto it = std::find_if(variable.annotations.cbegin(), variable.annotations.cend(),
-				[&](const reshadefx::annotation &annotation) { return annotation.name == name; });
-			it != variable.annotations.cend())
+		if (const reshadefx::annotation *const annotation = find_annotation(variable.annotations, name))
 		{
-			const std::string_view annotation = variable.annotation_as_string(name);
+			const std::string_view value_string(annotation->value.string_data);
 
 			if (size != nullptr)
 			{
 				if (value == nullptr)
 				{
-					*size = annotation.size() + 1;
+					*size = value_string.size() + 1;
 				}
 				else if (*size != 0)
 				{
-					*size = annotation.copy(value, *size - 1);
+					*size = value_string.copy(value, *size - 1);
 					value[*size] = '\0';
 				}
 			}
@@ -771,15 +756,17 @@ reshade::api::effect_technique reshade::runtime::find_technique(const char *effe
 	if (is_loading() || technique_name_in == nullptr)
 		return { 0 };
 
-	const std::filesystem::path effect_name = effect_name_in != nullptr ? std::filesystem::u8path(effect_name_in) : std::filesystem::path();
-	const std::string_view technique_name(technique_name_in);
+	const auto it = _effect_name_index.techniques.find(technique_name_in);
+	if (it == _effect_name_index.techniques.end())
+		return { 0 };
 
-	for (const technique &technique : _techniques)
+	const std::string_view effect_name = effect_name_in != nullptr ? std::string_view(effect_name_in) : std::string_view();
+
+	for (const size_t technique_index : it->second)
 	{
-		if (effect_name_in != nullptr && _effects[technique.effect_index].source_file.filename() != effect_name)
-			continue;
+		const technique &technique = _techniques[technique_index];
 
-		if (technique.name != technique_name)
+		if (effect_name_in != nullptr && _effect_name_index.effect_file_names[technique.effect_index] != effect_name)
 			continue;
 
 		return { reinterpret_cast<uintptr_t>(&technique) };
@@ -842,12 +829,10 @@ bool reshade::runtime::get_annotation_bool_from_technique(api::effect_technique
 		const auto& tech = *reinterpret_cast<const technique *>(handle.handle);
 		const std::string_view name(name_in);
 
-		if (const auto it = std::find_if(tech.annotations.cbegin(), tech.annotations.cend(),
-				[&](const reshadefx::annotation &annotation) { return annotation.name == name; });
-			it != tech.annotations.cend())
+		if (const reshadefx::annotation *const annotation = find_annotation(tech.annotations, name))
 		{
 			for (size_t i = 0; i < count; ++i)
-				values[i] = tech.annotation_as_int(name, array_index + i) != 0;
+				values[i] = annotation_value_as_int(*annotation, array_index + i) != 0;
 			return true;
 		}
 	}
@@ -863,12 +848,10 @@ bool reshade::runtime::get_annotation_float_from_technique(api::effect_technique
 		const auto &tech = *reinterpret_cast<const technique *>(handle.handle);
 		const std::string_view name(name_in);
 
-		if (const auto it = std::find_if(tech.annotations.cbegin(), tech.annotations.cend(),
-				[&](const reshadefx::annotation &annotation) { return annotation.name == name; });
-			it != tech.annotations.cend())
+		if (const reshadefx::annotation *const annotation = find_annotation(tech.annotations, name))
 		{
 			for (size_t i = 0; i < count; ++i)
-				values[i] = tech.annotation_as_float(name, array_index + i);
+				values[i] = annotation_value_as_float(*annotation, array_index + i);
 			return true;
 		}
 	}
@@ -884,12 +867,10 @@ bool reshade::runtime::get_annotation_int_from_technique(api::effect_technique h
 		const auto &tech = *reinterpret_cast<const technique *>(handle.handle);
 		const std::string_view name(name_in);
 
-		if (const auto it = std::find_if(tech.annotations.cbegin(), tech.annotations.cend(),
-				[&](const reshadefx::annotation &annotation) { return annotation.name == name; });
-			it != tech.annotations.cend())
+		if (const reshadefx::annotation *const annotation = find_annotation(tech.annotations, name))
 		{
 			for (size_t i = 0; i < count; ++i)
-				values[i] = tech.annotation_as_int(name, array_index + i);
+				values[i] = annotation_value_as_int(*annotation, array_index + i);
 			return true;
 		}
 	}
@@ -905,12 +886,10 @@ bool reshade::runtime::get_annotation_uint_from_technique(api::effect_technique
 		const auto &tech = *reinterpret_cast<const technique *>(handle.handle);
 		const std::string_view name(name_in);
 
-		if (const auto it = std::find_if(tech.annotations.cbegin(), tech.annotations.cend(),
-				[&](const reshadefx::annotation &annotation) { return annotation.name == name; });
-			it != tech.annotations.cend())
+		if (const reshadefx::annotation *const annotation = find_annotation(tech.annotations, name))
 		{
 			for (size_t i = 0; i < count; ++i)
-				values[i] = tech.annotation_as_uint(name, array_index + i);
+				values[i] = annotation_value_as_uint(*annotation, array_index + i);
 			return true;
 		}
 	}
@@ -926,21 +905,19 @@ bool reshade::runtime::get_annotation_string_from_technique(api::effect_techniqu
 		const auto &tech = *reinterpret_cast<const technique *>(handle.handle);
 		const std::string_view name(name_in);
 
-		if (const auto it = std::find_if(tech.annotations.cbegin(), tech.annotations.cend(),
-				[&](const reshadefx::annotation &annotation) { return annotation.name == name; });
-			it != tech.annotations.cend())
+		if (const reshadefx::annotation *const annotation = find_annotation(tech.annotations, name))
 		{
-			const std::string_view annotation = tech.annotation_as_string(name);
+			const std::string_view value_string(annotation->value.string_data);
 
 			if (size != nullptr)
 			{
 				if (value == nullptr)
 				{
-					*size = annotation.size() + 1;
+					*size = value_string.size() + 1;
 				}
 				else if (*size != 0)
 				{
-					*size = annotation.copy(value, *size - 1);
+					*size = value_string.copy(value, *size - 1);
 					value[*size] = '\0';
 				}
 			}
@@ -1303,7 +1280,12 @@ void reshade::runtime::render_technique(api::effect_technique handle, api::comma
 	invoke_addon_event<addon_event::reshade_begin_effects>(this, cmd_list, rtv, rtv_srgb);
 #endif
 
-	render_technique(*tech, cmd_list, back_buffer_resource, rtv, rtv_srgb, permutation_index);
+	bool color_tex_up_to_date = false;
+	resource_state_tracker state_tracker;
+	render_technique(*tech, cmd_list, back_buffer_resource, rtv, rtv_srgb, permutation_index, color_tex_up_to_date, state_tracker);
+
+	state_tracker.restore();
+	state_tracker.flush(cmd_list);
 
 #if RESHADE_ADDON
 	invoke_addon_event<addon_event::reshade_finish_effects>(this, cmd_list, rtv, rtv_srgb);
@@ -32,36 +32,74 @@ namespace reshade
 		unknown
 	};
 
+	struct special_uniform_info
+	{
+		enum class input_mode : uint8_t
+		{
+			down,
+			press,
+			toggle
+		};
+
+		size_t uniform_index;
+		special_uniform source;
+		input_mode mode = input_mode::down;
+		int keycode = 0;
+		int int_min = 0, int_max = 0;
+		float float_min = 0.0f, float_max = 0.0f;
+		float step_min = 0.0f, step_max = 0.0f;
+		float smoothing = 0.0f;
+	};
+
+	/// <summary>
+	/// Finds the first annotation with the specified name, so that callers reading multiple values only have to search once.
+	/// </summary>
+	inline const reshadefx::annotation *find_annotation(const std::vector<reshadefx::annotation> &annotations, const std::string_view ann_name)
+	{
+		const auto it = std::find_if(annotations.cbegin(), annotations.cend(),
+			[ann_name](const reshadefx::annotation &annotation) { return annotation.name == ann_name; });
+		return it != annotations.cend() ? &(*it) : nullptr;
+	}
+
+	inline int annotation_value_as_int(const reshadefx::annotation &annotation, size_t i, int default_value = 0)
+	{
+		return i < 16 ?
+			(annotation.type.is_integral() ? annotation.value.as_int[i] : static_cast<int>(annotation.value.as_float[i])) : default_value;
+	}
+	inline unsigned int annotation_value_as_uint(const reshadefx::annotation &annotation, size_t i, unsigned int default_value = 0)
+	{
+		return i < 16 ?
+			(annotation.type.is_integral() ? annotation.value.as_uint[i] : static_cast<unsigned int>(annotation.value.as_float[i])) : default_value;
+	}
+	inline float annotation_value_as_float(const reshadefx::annotation &annotation, size_t i, float default_value = 0.0f)
+	{
+		return i < 16 ?
+			(annotation.type.is_floating_point() ? annotation.value.as_float[i] : static_cast<float>(annotation.value.as_int[i])) : default_value;
+	}
+
 	struct texture : reshadefx::texture
 	{
 		texture(const reshadefx::texture &init) : reshadefx::texture(init) {}
 
 		auto annotation_as_int(const std::string_view ann_name, size_t i = 0, int default_value = 0) const
 		{
-			const auto it = std::find_if(annotations.cbegin(), annotations.cend(),
-				[ann_name](const reshadefx::annotation &annotation) { return annotation.name == ann_name; });
-			return it != annotations.cend() && i < 16 ?
-				(it->type.is_integral() ? it->value.as_int[i] : static_cast<int>(it->value.as_float[i])) : default_value;
+			const reshadefx::annotation *const annotation = find_annotation(annotations, ann_name);
+			return annotation != nullptr ? annotation_value_as_int(*annotation, i, default_value) : default_value;
 		}
 		auto annotation_as_uint(const std::string_view ann_name, size_t i = 0, unsigned int default_value = 0) const
 		{
-			const auto it = std::find_if(annotations.cbegin(), annotations.cend(),
-				[ann_name](const reshadefx::annotation &annotation) { return annotation.name == ann_name; });
-			return it != annotations.cend() && i < 16 ?
-				(it->type.is_integral() ? it->value.as_uint[i] : static_cast<unsigned int>(it->value.as_float[i])) : default_value;
+			const reshadefx::annotation *const annotation = find_annotation(annotations, ann_name);
+			return annotation != nullptr ? annotation_value_as_uint(*annotation, i, default_value) : default_value;
 		}
 		auto annotation_as_float(const std::string_view ann_name, size_t i = 0, float default_value = 0.0f) const
 		{
-			const auto it = std::find_if(annotations.cbegin(), annotations.cend(),
-				[ann_name](const reshadefx::annotation &annotation) { return annotation.name == ann_name; });
-			return it != annotations.cend() && i < 16 ?
-				(it->type.is_floating_point() ? it->value.as_float[i] : static_cast<float>(it->value.as_int[i])) : default_value;
+			const reshadefx::annotation *const annotation = find_annotation(annotations, ann_name);
+			return annotation != nullptr ? annotation_value_as_float(*annotation, i, default_value) : default_value;
 		}
 		auto annotation_as_string(const std::string_view ann_name, const std::string_view default_value = std::string_view()) const
 		{
-			const auto it = std::find_if(annotations.cbegin(), annotations.cend(),
-				[ann_name](const reshadefx::annotation &annotation) { return annotation.name == ann_name; });
-			return it != annotations.cend() ? std::string_view(it->value.string_data) : default_value;
+			const reshadefx::annotation *const annotation = find_annotation(annotations, ann_name);
+			return annotation != nullptr ? std::string_view(annotation->value.string_data) : default_value;
 		}
 
 		bool matches_description(const reshadefx::texture &desc) const
@@ -84,31 +122,23 @@ namespace reshade
 
 		auto annotation_as_int(const std::string_view ann_name, size_t i = 0, int default_value = 0) const
 		{
-			const auto it = std::find_if(annotations.cbegin(), annotations.cend(),
-				[ann_name](const reshadefx::annotation &annotation) { return annotation.name == ann_name; });
-			return it != annotations.cend() && i < 16 ?
-				(it->type.is_integral() ? it->value.as_int[i] : static_cast<int>(it->value.as_float[i])) : default_value;
+			const reshadefx::annotation *const annotation = find_annotation(annotations, ann_name);
+			return annotation != nullptr ? annotation_value_as_int(*annotation, i, default_value) : default_value;
 		}
 		auto annotation_as_uint(const std::string_view ann_name, size_t i = 0, unsigned int default_value = 0) const
 		{
-			const auto it = std::find_if(annotations.cbegin(), annotations.cend(),
-				[ann_name](const reshadefx::annotation &annotation) { return annotation.name == ann_name; });
-			return it != annotations.cend() && i < 16 ?
-				(it->type.is_integral() ? it->value.as_uint[i] : static_cast<unsigned int>(it->value.as_float[i])) : default_value;
+			const reshadefx::annotation *const annotation = find_annotation(annotations, ann_name);
+			return annotation != nullptr ? annotation_value_as_uint(*annotation, i, default_value) : default_value;
 		}
 		auto annotation_as_float(const std::string_view ann_name, size_t i = 0, float default_value = 0.0f) const
 		{
-			const auto it = std::find_if(annotations.cbegin(), annotations.cend(),
-				[ann_name](const reshadefx::annotation &annotation) { return annotation.name == ann_name; });
-			return it != annotations.cend() && i < 16 ?
-				(it->type.is_floating_point() ? it->value.as_float[i] : static_cast<float>(it->value.as_int[i])) : default_value;
+			const reshadefx::annotation *const annotation = find_annotation(annotations, ann_name);
+			return annotation != nullptr ? annotation_value_as_float(*annotation, i, default_value) : default_value;
 		}
 		auto annotation_as_string(const std::string_view ann_name, const std::string_view default_value = std::string_view()) const
 		{
-			const auto it = std::find_if(annotations.cbegin(), annotations.cend(),
-				[ann_name](const reshadefx::annotation &annotation) { return annotation.name == ann_name; });
-			return it != annotations.cend() ?
-				std::string_view(it->value.string_data) : default_value;
+			const reshadefx::annotation *const annotation = find_annotation(annotations, ann_name);
+			return annotation != nullptr ? std::string_view(annotation->value.string_data) : default_value;
 		}
 
 		bool supports_toggle_key() const
@@ -144,31 +174,23 @@ namespace reshade
 
 		auto annotation_as_int(const std::string_view ann_name, size_t i = 0, int default_value = 0) const
 		{
-			const auto it = std::find_if(annotations.cbegin(), annotations.cend(),
-				[ann_name](const reshadefx::annotation &annotation) { return annotation.name == ann_name; });
-			return it != annotations.cend() && i < 16 ?
-				(it->type.is_integral() ? it->value.as_int[i] : static_cast<int>(it->value.as_float[i])) : default_value;
+			const reshadefx::annotation *const annotation = find_annotation(annotations, ann_name);
+			return annotation != nullptr ? annotation_value_as_int(*annotation, i, default_value) : default_value;
 		}
 		auto annotation_as_uint(const std::string_view ann_name, size_t i = 0, unsigned int default_value = 0) const
 		{
-			const auto it = std::find_if(annotations.cbegin(), annotations.cend(),
-				[ann_name](const reshadefx::annotation &annotation) { return annotation.name == ann_name; });
-			return it != annotations.cend() && i < 16 ?
-				(it->type.is_integral() ? it->value.as_uint[i] : static_cast<unsigned int>(it->value.as_float[i])) : default_value;
+			const reshadefx::annotation *const annotation = find_annotation(annotations, ann_name);
+			return annotation != nullptr ? annotation_value_as_uint(*annotation, i, default_value) : default_value;
 		}
 		auto annotation_as_float(const std::string_view ann_name, size_t i = 0, float default_value = 0.0f) const
 		{
-			const auto it = std::find_if(annotations.cbegin(), annotations.cend(),
-				[ann_name](const reshadefx::annotation &annotation) { return annotation.name == ann_name; });
-			return it != annotations.cend() && i < 16 ?
-				(it->type.is_floating_point() ? it->value.as_float[i] : static_cast<float>(it->value.as_int[i])) : default_value;
+			const reshadefx::annotation *const annotation = find_annotation(annotations, ann_name);
+			return annotation != nullptr ? annotation_value_as_float(*annotation, i, default_value) : default_value;
 		}
 		auto annotation_as_string(const std::string_view ann_name, const std::string_view default_value = std::string_view()) const
 		{
-			const auto it = std::find_if(annotations.cbegin(), annotations.cend(),
-				[ann_name](const reshadefx::annotation &annotation) { return annotation.name == ann_name; });
-			return it != annotations.cend() ?
-				std::string_view(it->value.string_data) : default_value;
+			const reshadefx::annotation *const annotation = find_annotation(annotations, ann_name);
+			return annotation != nullptr ? std::string_view(annotation->value.string_data) : default_value;
 		}
 
 		unsigned int toggle_key_data[4] = {};
@@ -194,6 +216,7 @@ namespace reshade
 			api::descriptor_table storage_table = {};
 			std::vector<api::resource> modified_resources;
 			std::vector<api::resource_view> generate_mipmap_views;
+			bool samples_back_buffer = false;
 
 			moving_average<uint64_t, 60> average_gpu_duration;
 		};
@@ -224,7 +247,14 @@ namespace reshade
 		std::vector<std::pair<std::string, std::string>> definitions;
 
 		std::vector<uniform> uniforms;
+		// Index into 'uniforms' by name (first occurrence), so that the add-on API can look variables up without a linear search
+		std::unordered_map<std::string, size_t> uniform_indices;
 		std::vector<uint8_t> uniform_data_storage;
+		// Byte range in 'uniform_data_storage' that was modified since the last upload to the constant buffer
+		size_t uniform_data_dirty_begin = std::numeric_limits<size_t>::max();
+		size_t uniform_data_dirty_end = 0;
+		// Annotations of uniform variables with a special source, resolved once during creation so they do not need to be looked up every frame
+		std::vector<special_uniform_info> special_uniforms;
 		api::resource cb = {};
 
 		struct binding
@@ -253,5 +283,102 @@ namespace reshade
 		std::vector<permutation> permutations;
 
 		api::query_heap query_heap = {};
+
+		void mark_uniform_data_dirty(size_t offset, size_t size)
+		{
+			uniform_data_dirty_begin = std::min(uniform_data_dirty_begin, offset);
+			uniform_data_dirty_end = std::max(uniform_data_dirty_end, offset + size);
+		}
+		void clear_uniform_data_dirty()
+		{
+			uniform_data_dirty_begin = std::numeric_limits<size_t>::max();
+			uniform_data_dirty_end = 0;
+		}
+	};
+
+	/// <summary>
+	/// Keeps track of the current usage state of resources while rendering effects, so that transitions can be deferred and batched into a single barrier call, and redundant ones elided.
+	/// </summary>
+	class resource_state_tracker
+	{
+	public:
+		/// <summary>
+		/// Queues a transition of the specified <paramref name="resource"/> to a new state.
+		/// </summary>
+		/// <param name="default_state">State the resource is in outside of effect rendering, used if this resource is not tracked yet.</param>
+		void transition(api::resource resource, api::resource_usage default_state, api::resource_usage new_state)
+		{
+			auto it = std::find_if(_resources.begin(), _resources.end(),
+				[resource](const tracked_resource &item) { return item.resource == resource; });
+			if (it == _resources.end())
+				it = _resources.insert(_resources.end(), { resource, default_state, default_state });
+
+			const api::resource_usage old_state = it->current_state;
+			it->current_state = new_state;
+
+			// Writes to unordered access views still need to be synchronized, even if there is no state change
+			if (old_state == new_state && new_state != api::resource_usage::unordered_access)
+				return;
+
+			// Merge with an existing transition of this resource that was not yet flushed
+			if (const auto pending_it = std::find(_pending_resources.begin(), _pending_resources.end(), resource);
+				pending_it != _pending_resources.end())
+			{
+				const size_t pending_index = pending_it - _pending_resources.begin();
+				if (_pending_old_states[pending_index] == new_state && new_state != api::resource_usage::unordered_access)
+				{
+					_pending_resources.erase(pending_it);
+					_pending_old_states.erase(_pending_old_states.begin() + pending_index);
+					_pending_new_states.erase(_pending_new_states.begin() + pending_index);
+				}
+				else
+				{
+					_pending_new_states[pending_index] = new_state;
+				}
+				return;
+			}
+
+			_pending_resources.push_back(resource);
+			_pending_old_states.push_back(old_state);
+			_pending_new_states.push_back(new_state);
+		}
+
+		/// <summary>
+		/// Queues transitions of all tracked resources back to their default state, except for those in the specified list.
+		/// </summary>
+		void restore(size_t except_count = 0, const api::resource *except_resources = nullptr)
+		{
+			for (const tracked_resource &item : _resources)
+				if (item.current_state != item.default_state && std::find(except_resources, except_resources + except_count, item.resource) == except_resources + except_count)
+					transition(item.resource, item.default_state, item.default_state);
+		}
+
+		/// <summary>
+		/// Records all queued transitions into the specified command list.
+		/// </summary>
+		void flush(api::command_list *cmd_list)
+		{
+			if (_pending_resources.empty())
+				return;
+
+			cmd_list->barrier(static_cast<uint32_t>(_pending_resources.size()), _pending_resources.data(), _pending_old_states.data(), _pending_new_states.data());
+
+			_pending_resources.clear();
+			_pending_old_states.clear();
+			_pending_new_states.clear();
+		}
+
+	private:
+		struct tracked_resource
+		{
+			api::resource resource;
+			api::resource_usage default_state;
+			api::resource_usage current_state;
+		};
+
+		std::vector<tracked_resource> _resources;
+		std::vector<api::resource> _pending_resources;
+		std::vector<api::resource_usage> _pending_old_states;
+		std::vector<api::resource_usage> _pending_new_states;
 	};
 }
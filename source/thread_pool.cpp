@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2026 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause OR MIT
+ */
+
+#include "thread_pool.hpp"
+#include <atomic>
+#include <memory>
+#include <limits>
+#include <algorithm> // std::max, std::min, std::pop_heap, std::push_heap
+
+reshade::thread_pool::thread_pool(size_t max_threads) :
+	_max_threads(max_threads != 0 ? max_threads : static_cast<size_t>(std::max(std::thread::hardware_concurrency(), 2u) - 1))
+{
+}
+reshade::thread_pool::~thread_pool()
+{
+	{ const std::unique_lock<std::mutex> lock(_mutex);
+		_exit = true;
+	}
+
+	_task_available.notify_all();
+
+	// Worker threads drain the remaining queue before exiting, so that no submitted task is silently dropped
+	for (std::thread &thread : _threads)
+		thread.join();
+}
+
+void reshade::thread_pool::submit(std::function<void()> task, uint64_t cost)
+{
+	{ const std::unique_lock<std::mutex> lock(_mutex);
+		_queue.push_back({ cost, _next_sequence++, std::move(task) });
+		std::push_heap(_queue.begin(), _queue.end());
+
+		// Only spawn another worker if all existing ones are busy, to avoid launch overhead and stutters due to too many threads being in flight
+		if (_threads.size() < _max_threads && _threads.size() < _num_running + _queue.size())
+			_threads.emplace_back(&thread_pool::worker_main, this);
+	}
+
+	_task_available.notify_one();
+}
+
+void reshade::thread_pool::wait_idle()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_task_finished.wait(lock, [this]() { return _queue.empty() && _num_running == 0; });
+}
+
+void reshade::thread_pool::parallel_for(size_t count, const std::function<void(size_t)> &fun, size_t max_concurrency)
+{
+	if (count == 0)
+		return;
+
+	if (max_concurrency == 0 || max_concurrency > _max_threads + 1)
+		max_concurrency = _max_threads + 1;
+
+	const size_t num_helpers = std::min(count, max_concurrency) - 1;
+	if (num_helpers == 0)
+	{
+		for (size_t i = 0; i < count; ++i)
+			fun(i);
+		return;
+	}
+
+	// Shared state is reference counted, so that helper tasks which only start after all work was already done by others can still safely access it
+	struct state
+	{
+		const std::function<void(size_t)> *fun;
+		size_t count;
+		std::atomic<size_t> next_index = 0;
+		std::atomic<size_t> num_finished = 0;
+		std::mutex mutex;
+		std::condition_variable finished;
+
+		void run()
+		{
+			size_t num_run = 0;
+			for (size_t i; (i = next_index.fetch_add(1)) < count; ++num_run)
+				(*fun)(i);
+
+			if (num_run != 0 && num_finished.fetch_add(num_run) + num_run == count)
+			{
+				const std::unique_lock<std::mutex> lock(mutex);
+				finished.notify_all();
+			}
+		}
+	};
+
+	const auto shared_state = std::make_shared<state>();
+	shared_state->fun = &fun;
+	shared_state->count = count;
+
+	for (size_t n = 0; n < num_helpers; ++n)
+		submit([shared_state]() { shared_state->run(); }, std::numeric_limits<uint64_t>::max());
+
+	// Participate in the work, which guarantees progress even if all worker threads are busy (or this is called from a worker thread itself)
+	shared_state->run();
+
+	std::unique_lock<std::mutex> lock(shared_state->mutex);
+	shared_state->finished.wait(lock, [&shared_state]() { return shared_state->num_finished == shared_state->count; });
+}
+
+void reshade::thread_pool::worker_main()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	while (true)
+	{
+		_task_available.wait(lock, [this]() { return _exit || !_queue.empty(); });
+
+		if (_queue.empty())
+			break; // Exit was requested and there is no more work left to do
+
+		std::pop_heap(_queue.begin(), _queue.end());
+		std::function<void()> fun = std::move(_queue.back().fun);
+		_queue.pop_back();
+
+		_num_running++;
+		lock.unlock();
+
+		fun();
+		fun = nullptr; // Release any captured state outside the lock
+
+		lock.lock();
+		_num_running--;
+
+		if (_queue.empty() && _num_running == 0)
+			_task_finished.notify_all();
+	}
+}
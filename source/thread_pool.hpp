@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2026 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause OR MIT
+ */
+
+#pragma once
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace reshade
+{
+	/// <summary>
+	/// A persistent pool of worker threads that executes queued tasks in order of their estimated cost, largest first.
+	/// Threads are only spawned when the first task is submitted and live until the pool is destroyed.
+	/// </summary>
+	class thread_pool
+	{
+	public:
+		/// <summary>
+		/// Creates a new thread pool.
+		/// </summary>
+		/// <param name="max_threads">Maximum number of worker threads to spawn, or zero to choose based on the number of hardware threads.</param>
+		explicit thread_pool(size_t max_threads = 0);
+		~thread_pool();
+
+		thread_pool(const thread_pool &) = delete;
+		thread_pool &operator=(const thread_pool &) = delete;
+
+		/// <summary>
+		/// Gets the number of worker threads this pool uses.
+		/// </summary>
+		size_t size() const { return _max_threads; }
+
+		/// <summary>
+		/// Queues a task for execution on one of the worker threads.
+		/// </summary>
+		/// <param name="task">Function to execute.</param>
+		/// <param name="cost">Estimated cost of the task (e.g. file size or previous execution time). Tasks with a higher cost are started first, so they do not end up on the critical path.</param>
+		void submit(std::function<void()> task, uint64_t cost = 0);
+
+		/// <summary>
+		/// Blocks the calling thread until all queued tasks have finished executing.
+		/// </summary>
+		void wait_idle();
+
+		/// <summary>
+		/// Calls the specified function for every index in the range [0, <paramref name="count"/>) in parallel and waits for all of them to finish.
+		/// The calling thread participates in the work, so this is safe to call from within a task running on this pool.
+		/// </summary>
+		/// <param name="max_concurrency">Maximum number of threads (including the calling one) working on this range at the same time, or zero to use all worker threads.</param>
+		void parallel_for(size_t count, const std::function<void(size_t)> &fun, size_t max_concurrency = 0);
+
+	private:
+		struct task
+		{
+			uint64_t cost;
+			uint64_t sequence;
+			std::function<void()> fun;
+
+			bool operator<(const task &other) const { return cost < other.cost || (cost == other.cost && sequence > other.sequence); }
+		};
+
+		void worker_main();
+
+		const size_t _max_threads;
+		std::mutex _mutex;
+		std::condition_variable _task_available;
+		std::condition_variable _task_finished;
+		std::vector<task> _queue;
+		std::vector<std::thread> _threads;
+		uint64_t _next_sequence = 0;
+		size_t _num_running = 0;
+		bool _exit = false;
+	};
+}
@@ -6,14 +6,49 @@
 #include "effect_parser.hpp"
 #include "effect_codegen.hpp"
 #include "effect_preprocessor.hpp"
+#include "effect_cache.hpp"
+#include "thread_pool.hpp"
 #include "version.h"
+#include <chrono>
+#include <cctype> // std::tolower
+#include <cstdlib> // std::free, std::malloc
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <new> // std::bad_alloc
+#include <algorithm> // std::transform
+#include <unordered_map>
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#endif
+
+// Count allocations per thread, so that they can be attributed to the compilation phase (and effect file in batch mode) that caused them
+static thread_local size_t s_num_allocations = 0;
+static thread_local uint64_t s_num_allocated_bytes = 0;
+
+void *operator new(size_t size)
+{
+	s_num_allocations++;
+	s_num_allocated_bytes += size;
+
+	if (void *const ptr = std::malloc(size != 0 ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+void operator delete(void *ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
 
 static void print_usage(const char *path)
 {
 	printf(R"(usage: %s [options] <filename>
+       %s [options] --batch <path> [--batch <path> ...]
 
 Options:
   -h, --help                Print this help.
@@ -25,10 +60,10 @@ Options:
 
   -E <name>                 Optional entry point name to assemble code for that specific entry point.
   -Od                       Disable optimization.
-  -O{0,1,2,3}               Optimization level (only applies to DXBC code generation).
+  -O{0,1,2,3}               Optimization level (only applies to DXBC and SPIR-V code generation).
   -Zi                       Enable debug information.
 
-  -Fo <path>                Output generated code to a specific file.
+  -Fo <path>                Output generated code to a specific file (or directory in batch mode, which mirrors the directory structure of the input files).
   -Fe <path>                Output warnings and errors to a specific file.
 
   --dxbc                    Generate DXBC code.
@@ -42,7 +77,316 @@ Options:
   --spec-constants          Convert uniform variables to specialization constants.
   --invert-y                Insert code to invert the Y component of the output position in vertex shaders (only applies to GLSL/SPIR-V code generation).
   --vulkan-semantics        Generate GLSL/SPIR-V code under Vulkan semantics, instead of OpenGL semantics.
-	)", path);
+
+Batch mode:
+  --batch <path>            Compile all effect files in a directory (recursively), or listed in a manifest file (one path per line), instead of a single file.
+                            Multiple code generation targets may be specified at once. Each effect file is pre-processed once for all of them.
+  -j <count>                Number of threads to compile effect files with (default: number of hardware threads).
+  --cache <path>            Add compiled entry points to the effect cache archive at <path>, so that ReShade can skip compiling them again.
+  --renderer <id>           Renderer ID (in hexadecimal, e.g. "b000" for D3D11) the effect cache entries are created for.
+
+  --time-report             Print time and number of allocations spent in each compilation phase to standard error.
+  --time-report-json <path> Write time and number of allocations spent in each compilation phase to a JSON file.
+	)", path, path);
+}
+
+struct compile_options
+{
+	std::vector<std::pair<std::string, std::string>> macro_definitions;
+	std::vector<std::filesystem::path> include_paths;
+	bool debug_info = false;
+	bool invert_y_axis = false;
+	bool spec_constants = false;
+	bool vulkan_semantics = false;
+	unsigned int shader_model = 50;
+	int optimization_level = 1;
+	uint32_t renderer_id = 0;
+	reshade::effect_cache *cache = nullptr;
+};
+
+enum class compile_target
+{
+	dxbc,
+	hlsl,
+	glsl,
+	spirv
+};
+
+static const char *const s_target_names[] = { "dxbc", "hlsl", "glsl", "spirv" };
+
+struct phase_timing
+{
+	std::string name;
+	double milliseconds;
+	size_t num_allocations;
+	uint64_t num_allocated_bytes;
+};
+
+/// <summary>
+/// Measures time and allocations spent from construction to destruction of this object and adds them to a list of phase timings.
+/// </summary>
+class scoped_phase_timer
+{
+public:
+	scoped_phase_timer(std::vector<phase_timing> &timings, std::string name) :
+		_timings(timings),
+		_name(std::move(name)),
+		_start_num_allocations(s_num_allocations),
+		_start_num_allocated_bytes(s_num_allocated_bytes),
+		_start_time(std::chrono::high_resolution_clock::now())
+	{
+	}
+	~scoped_phase_timer()
+	{
+		const std::chrono::high_resolution_clock::time_point end_time = std::chrono::high_resolution_clock::now();
+
+		_timings.push_back({ std::move(_name), std::chrono::duration<double, std::milli>(end_time - _start_time).count(), s_num_allocations - _start_num_allocations, s_num_allocated_bytes - _start_num_allocated_bytes });
+	}
+
+private:
+	std::vector<phase_timing> &_timings;
+	std::string _name;
+	const size_t _start_num_allocations;
+	const uint64_t _start_num_allocated_bytes;
+	const std::chrono::high_resolution_clock::time_point _start_time;
+};
+
+static uint64_t peak_memory_usage()
+{
+#ifdef _WIN32
+	if (PROCESS_MEMORY_COUNTERS counters = { sizeof(counters) };
+		GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize;
+#endif
+	return 0;
+}
+
+static void print_time_report(std::ostream &stream, const std::string &source_file, const std::vector<phase_timing> &timings)
+{
+	double total_milliseconds = 0.0;
+	size_t total_num_allocations = 0;
+
+	stream << source_file << ":\n";
+	for (const phase_timing &timing : timings)
+	{
+		char line[256];
+		std::snprintf(line, sizeof(line), "  %-48s %10.3f ms %10zu allocations %12llu bytes\n", timing.name.c_str(), timing.milliseconds, timing.num_allocations, static_cast<unsigned long long>(timing.num_allocated_bytes));
+		stream << line;
+
+		total_milliseconds += timing.milliseconds;
+		total_num_allocations += timing.num_allocations;
+	}
+
+	char line[256];
+	std::snprintf(line, sizeof(line), "  %-48s %10.3f ms %10zu allocations\n", "total", total_milliseconds, total_num_allocations);
+	stream << line;
+}
+
+static void write_json_string(std::ostream &stream, const std::string &value)
+{
+	stream << '\"';
+	for (const char c : value)
+	{
+		if (c == '\"' || c == '\\')
+			stream << '\\' << c;
+		else if (static_cast<unsigned char>(c) < 0x20)
+			stream << ' ';
+		else
+			stream << c;
+	}
+	stream << '\"';
+}
+static void write_time_report_json(std::ostream &stream, const std::vector<std::string> &source_files, const std::vector<std::vector<phase_timing>> &timings, double total_milliseconds)
+{
+	stream << "{\n\t\"files\": [";
+	for (size_t i = 0; i < source_files.size(); ++i)
+	{
+		stream << (i != 0 ? ",\n" : "\n") << "\t\t{\n\t\t\t\"path\": ";
+		write_json_string(stream, source_files[i]);
+		stream << ",\n\t\t\t\"phases\": [";
+
+		for (size_t k = 0; k < timings[i].size(); ++k)
+		{
+			const phase_timing &timing = timings[i][k];
+
+			stream << (k != 0 ? ",\n" : "\n") << "\t\t\t\t{ \"name\": ";
+			write_json_string(stream, timing.name);
+			stream << ", \"milliseconds\": " << timing.milliseconds << ", \"allocations\": " << timing.num_allocations << ", \"allocated_bytes\": " << timing.num_allocated_bytes << " }";
+		}
+
+		stream << "\n\t\t\t]\n\t\t}";
+	}
+	stream << "\n\t],\n\t\"total_milliseconds\": " << total_milliseconds << ",\n\t\"peak_memory_bytes\": " << peak_memory_usage() << "\n}\n";
+}
+
+static void prepare_preprocessor(reshadefx::preprocessor &pp, const compile_options &options)
+{
+	for (const std::pair<std::string, std::string> &definition : options.macro_definitions)
+		pp.add_macro_definition(definition.first, definition.second);
+	for (const std::filesystem::path &include_path : options.include_paths)
+		pp.add_include_path(include_path);
+}
+
+static reshadefx::codegen *create_codegen(compile_target target, const compile_options &options)
+{
+	switch (target)
+	{
+	case compile_target::dxbc:
+		return reshadefx::create_codegen_dxbc(options.shader_model, options.debug_info, options.spec_constants, options.optimization_level);
+	case compile_target::hlsl:
+		return reshadefx::create_codegen_hlsl(options.shader_model, options.debug_info, options.spec_constants);
+	case compile_target::glsl:
+		return reshadefx::create_codegen_glsl(options.vulkan_semantics, options.debug_info, options.spec_constants, options.invert_y_axis);
+	case compile_target::spirv:
+		return reshadefx::create_codegen_spirv(options.vulkan_semantics, options.debug_info, options.spec_constants, false, options.invert_y_axis, options.optimization_level);
+	default:
+		return nullptr;
+	}
+}
+
+static bool compile_batch_file(const std::filesystem::path &source_file, const std::vector<compile_target> &targets, const compile_options &options, const std::filesystem::path &output_base, std::string &errors, std::vector<phase_timing> &timings)
+{
+	reshadefx::preprocessor pp;
+	prepare_preprocessor(pp, options);
+
+	bool preprocessed = false;
+	{ const scoped_phase_timer timer(timings, "preprocess");
+		preprocessed = pp.append_file(source_file);
+	}
+
+	if (!preprocessed)
+	{
+		errors += pp.errors();
+		return false;
+	}
+
+	errors += pp.errors();
+
+	const std::string source_stem = source_file.stem().u8string();
+
+	// This has to match the identifiers 'reshade::runtime::load_effect' uses for compiled entry points (which does not use performance mode when specialization constants are disabled)
+	const uint64_t codegen_options_hash = reshade::hash_data(std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION) + ';' + std::to_string(options.shader_model) + ';' + (options.debug_info ? '1' : '0') + (options.spec_constants ? '1' : '0'));
+
+	bool success = true;
+
+	for (const compile_target target : targets)
+	{
+		const std::unique_ptr<reshadefx::codegen> backend(create_codegen(target, options));
+		if (backend == nullptr)
+		{
+			errors += "error: code generation target is not supported with the specified options\n";
+			success = false;
+			continue;
+		}
+
+		const std::string target_name = s_target_names[static_cast<size_t>(target)];
+
+		reshadefx::parser parser;
+		bool parsed = false;
+		{ const scoped_phase_timer timer(timings, "parse (" + target_name + ')');
+			parsed = parser.parse(pp.output(), backend.get());
+		}
+
+		if (!parsed)
+		{
+			errors += parser.errors();
+			success = false;
+			continue;
+		}
+
+		errors += parser.errors();
+
+		if (target == compile_target::hlsl || target == compile_target::glsl)
+		{
+			std::string code;
+			{ const scoped_phase_timer timer(timings, "finalize (" + target_name + ')');
+				code = backend->finalize_code();
+			}
+
+			if (!output_base.empty())
+				std::ofstream(std::filesystem::u8path(output_base.u8string() + (target == compile_target::hlsl ? ".hlsl" : ".glsl")), std::ios::binary).write(code.data(), code.size());
+			continue;
+		}
+
+		for (const std::pair<std::string, reshadefx::shader_type> &entry_point : backend->module().entry_points)
+		{
+			std::string code, assembly;
+			bool assembled = false;
+			{ const scoped_phase_timer timer(timings, "assemble (" + target_name + ") " + entry_point.first);
+				assembled = backend->assemble_code_for_entry_point(entry_point.first, code, assembly, errors);
+			}
+
+			if (!assembled)
+			{
+				success = false;
+				continue;
+			}
+
+			if (!output_base.empty())
+				std::ofstream(std::filesystem::u8path(output_base.u8string() + '.' + entry_point.first + (target == compile_target::dxbc ? ".cso" : ".spv")), std::ios::binary).write(code.data(), code.size());
+
+			// Entries can only be identified independently of the rest of the runtime state if the code generator supports hashing entry points and no specialization constants are involved
+			if (options.cache != nullptr && !options.spec_constants)
+			{
+				if (const size_t code_hash = backend->hash_code_for_entry_point(entry_point.first); code_hash != 0)
+				{
+					// The hash of specialization constant values is always zero when they are disabled
+					const std::string cache_id = source_stem + '-' + std::to_string(options.renderer_id) + '-' + std::to_string(reshade::hash_data(&code_hash, sizeof(code_hash), codegen_options_hash)) + "-0-" + entry_point.first;
+
+					options.cache->save(cache_id + ".cso", code);
+					options.cache->save(cache_id + ".asm", assembly);
+				}
+			}
+		}
+	}
+
+	return success;
+}
+
+/// <summary>
+/// Gets the path output files for the specified effect file are named after, which is its path relative to the directory or manifest it was found through, without the extension.
+/// Effect files outside that directory are named after just their file name.
+/// </summary>
+static std::filesystem::path get_batch_output_name(const std::filesystem::path &source_file, const std::filesystem::path &base_path)
+{
+	std::filesystem::path relative_path = source_file.lexically_normal().lexically_relative(base_path.lexically_normal());
+	if (relative_path.empty() || *relative_path.begin() == "..")
+		relative_path = source_file.filename();
+
+	return relative_path.replace_extension();
+}
+
+static void append_batch_files(const std::filesystem::path &path, std::vector<std::filesystem::path> &source_files, std::vector<std::filesystem::path> &output_names)
+{
+	std::error_code ec;
+	if (std::filesystem::is_directory(path, ec))
+	{
+		for (const std::filesystem::directory_entry &entry : std::filesystem::recursive_directory_iterator(path, std::filesystem::directory_options::skip_permission_denied, ec))
+		{
+			if (entry.is_regular_file(ec) && (entry.path().extension() == ".fx" || entry.path().extension() == ".addonfx"))
+			{
+				source_files.push_back(entry.path());
+				output_names.push_back(get_batch_output_name(entry.path(), path));
+			}
+		}
+		return;
+	}
+
+	// Any other file is a manifest listing effect files, with paths relative to the manifest
+	std::ifstream manifest(path);
+	for (std::string line; std::getline(manifest, line);)
+	{
+		line.erase(0, line.find_first_not_of(" \t"));
+		line.erase(line.find_last_not_of(" \t\r") + 1);
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::filesystem::path source_file = std::filesystem::u8path(line);
+		if (source_file.is_relative())
+			source_file = path.parent_path() / source_file;
+		output_names.push_back(get_batch_output_name(source_file, path.parent_path()));
+		source_files.push_back(std::move(source_file));
+	}
 }
 
 int main(int argc, char *argv[])
@@ -51,6 +395,8 @@ int main(int argc, char *argv[])
 	const char *preprocess_file = nullptr;
 	const char *error_file = nullptr;
 	const char *output_file = nullptr;
+	const char *cache_file = nullptr;
+	const char *time_report_file = nullptr;
 	const char *entry_point_name = nullptr;
 	const char *buffer_width = "800";
 	const char *buffer_height = "600";
@@ -58,14 +404,11 @@ int main(int argc, char *argv[])
 	bool generate_hlsl = false;
 	bool generate_glsl = false;
 	bool generate_spirv = false;
-	bool debug_info = false;
-	bool invert_y_axis = false;
-	bool spec_constants = false;
-	bool vulkan_semantics = false;
-	unsigned int shader_model = 50;
-	unsigned int optimization_level = 1;
+	bool time_report = false;
+	size_t num_threads = 0;
+	std::vector<std::filesystem::path> batch_paths;
 
-	reshadefx::preprocessor pp;
+	compile_options options;
 
 	// Parse command-line arguments
 	for (int i = 1; i < argc; ++i)
@@ -88,28 +431,28 @@ int main(int argc, char *argv[])
 				char *name = argv[++i];
 				char *value = std::strchr(name, '=');
 				if (value) *value++ = '\0';
-				pp.add_macro_definition(name, value ? value : "1");
+				options.macro_definitions.emplace_back(name, value ? value : "1");
 				continue;
 			}
 
 			if (0 == std::strcmp(arg, "-I"))
 			{
-				pp.add_include_path(argv[++i]);
+				options.include_paths.push_back(argv[++i]);
 				continue;
 			}
 
 			if (0 == std::strcmp(arg, "-Zi"))
-				debug_info = true;
+				options.debug_info = true;
 			else if (0 == std::strcmp(arg, "-Od"))
-				optimization_level = -1;
+				options.optimization_level = -1;
 			else if (0 == std::strcmp(arg, "-O0"))
-				optimization_level = 0;
+				options.optimization_level = 0;
 			else if (0 == std::strcmp(arg, "-O1"))
-				optimization_level = 1;
+				options.optimization_level = 1;
 			else if (0 == std::strcmp(arg, "-O2"))
-				optimization_level = 2;
+				options.optimization_level = 2;
 			else if (0 == std::strcmp(arg, "-O3"))
-				optimization_level = 3;
+				options.optimization_level = 3;
 			else if (0 == std::strcmp(arg, "--dxbc"))
 				generate_dxbc = true;
 			else if (0 == std::strcmp(arg, "--hlsl"))
@@ -119,11 +462,13 @@ int main(int argc, char *argv[])
 			else if (0 == std::strcmp(arg, "--spirv"))
 				generate_spirv = true;
 			else if (0 == std::strcmp(arg, "--invert-y"))
-				invert_y_axis = true;
+				options.invert_y_axis = true;
 			else if (0 == std::strcmp(arg, "--spec-constants"))
-				spec_constants = true;
+				options.spec_constants = true;
 			else if (0 == std::strcmp(arg, "--vulkan-semantics"))
-				vulkan_semantics = true;
+				options.vulkan_semantics = true;
+			else if (0 == std::strcmp(arg, "--time-report"))
+				time_report = true;
 
 			if (i + 1 >= argc)
 				continue;
@@ -136,11 +481,21 @@ int main(int argc, char *argv[])
 			else if (0 == std::strcmp(arg, "-Fo"))
 				output_file = argv[++i];
 			else if (0 == std::strcmp(arg, "--shader-model"))
-				shader_model = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+				options.shader_model = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
 			else if (0 == std::strcmp(arg, "--width"))
 				buffer_width = argv[++i];
 			else if (0 == std::strcmp(arg, "--height"))
 				buffer_height = argv[++i];
+			else if (0 == std::strcmp(arg, "--batch"))
+				batch_paths.push_back(std::filesystem::u8path(argv[++i]));
+			else if (0 == std::strcmp(arg, "-j"))
+				num_threads = static_cast<size_t>(std::strtoul(argv[++i], nullptr, 10));
+			else if (0 == std::strcmp(arg, "--cache"))
+				cache_file = argv[++i];
+			else if (0 == std::strcmp(arg, "--renderer"))
+				options.renderer_id = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 16));
+			else if (0 == std::strcmp(arg, "--time-report-json"))
+				time_report_file = argv[++i];
 		}
 		else
 		{
@@ -157,7 +512,7 @@ int main(int argc, char *argv[])
 	// Try to infer backend from output file extension when not specified
 	if (!generate_dxbc && !generate_hlsl && !generate_glsl && !generate_spirv)
 	{
-		if (output_file != nullptr)
+		if (output_file != nullptr && batch_paths.empty())
 		{
 			const char *ext = std::strrchr(output_file, '.');
 			if (ext == nullptr || std::strcmp(ext, ".cso") == 0 || std::strcmp(ext, ".bin") == 0)
@@ -175,21 +530,183 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	options.macro_definitions.emplace_back("__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION));
+	options.macro_definitions.emplace_back("__RESHADE_PERFORMANCE_MODE__", "0");
+	options.macro_definitions.emplace_back("BUFFER_WIDTH", buffer_width);
+	options.macro_definitions.emplace_back("BUFFER_HEIGHT", buffer_height);
+	options.macro_definitions.emplace_back("BUFFER_RCP_WIDTH", "(1.0 / BUFFER_WIDTH)");
+	options.macro_definitions.emplace_back("BUFFER_RCP_HEIGHT", "(1.0 / BUFFER_HEIGHT)");
+
+	if (!batch_paths.empty())
+	{
+		if (source_file != nullptr || preprocess_file != nullptr || entry_point_name != nullptr || (cache_file != nullptr && options.renderer_id == 0))
+		{
+			print_usage(argv[0]);
+			return 1;
+		}
+
+		std::vector<compile_target> targets;
+		if (generate_dxbc)
+			targets.push_back(compile_target::dxbc);
+		if (generate_hlsl)
+			targets.push_back(compile_target::hlsl);
+		if (generate_glsl)
+			targets.push_back(compile_target::glsl);
+		if (generate_spirv)
+			targets.push_back(compile_target::spirv);
+
+		std::vector<std::filesystem::path> source_files;
+		std::vector<std::filesystem::path> output_names;
+		for (const std::filesystem::path &batch_path : batch_paths)
+			append_batch_files(batch_path, source_files, output_names);
+
+		// Path of each effect file in the output directory, without extension
+		std::vector<std::filesystem::path> output_bases(source_files.size());
+		if (output_file != nullptr)
+		{
+			const std::filesystem::path output_path = std::filesystem::u8path(output_file);
+
+			// Effect files found through different batch paths may still end up with the same output name, which would cause them to overwrite each other's output files (possibly from different threads at the same time)
+			std::unordered_map<std::string, size_t> output_name_owners;
+			std::string output_name_errors;
+			for (size_t i = 0; i < source_files.size(); ++i)
+			{
+				std::string key = output_names[i].generic_u8string();
+				// File names are case-insensitive on Windows
+				std::transform(key.begin(), key.end(), key.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+
+				if (const auto insert = output_name_owners.emplace(std::move(key), i);
+					!insert.second)
+				{
+					output_name_errors += "error: '" + source_files[i].u8string() + "' and '" + source_files[insert.first->second].u8string() + "' would both write output files named '" + output_names[i].u8string() + "'\n";
+				}
+			}
+
+			if (!output_name_errors.empty())
+			{
+				if (error_file == nullptr)
+					std::cout << output_name_errors;
+				else
+					std::ofstream(error_file) << output_name_errors;
+				return 1;
+			}
+
+			for (size_t i = 0; i < source_files.size(); ++i)
+			{
+				output_bases[i] = output_path / output_names[i];
+
+				// Create directories up front, rather than from multiple threads during compilation
+				std::error_code ec;
+				std::filesystem::create_directories(output_bases[i].parent_path(), ec);
+			}
+		}
+
+		std::unique_ptr<reshade::effect_cache> cache;
+		if (cache_file != nullptr)
+			options.cache = (cache = std::make_unique<reshade::effect_cache>(std::filesystem::absolute(std::filesystem::u8path(cache_file)))).get();
+
+		std::vector<std::string> errors(source_files.size());
+		// Not using 'std::vector<bool>' here, since its elements cannot be written to from multiple threads
+		std::vector<char> results(source_files.size());
+		std::vector<std::vector<phase_timing>> timings(source_files.size());
+
+		const std::chrono::high_resolution_clock::time_point start_time = std::chrono::high_resolution_clock::now();
+
+		{ reshade::thread_pool pool(num_threads);
+			for (size_t i = 0; i < source_files.size(); ++i)
+			{
+				std::error_code ec;
+				const uintmax_t file_size = std::filesystem::file_size(source_files[i], ec);
+
+				// Larger files are started first, so that they do not end up being the last ones still compiling
+				pool.submit([&, i]() {
+					results[i] = compile_batch_file(source_files[i], targets, options, output_bases[i], errors[i], timings[i]);
+				}, ec ? 0 : static_cast<uint64_t>(file_size));
+			}
+
+			pool.wait_idle();
+		}
+
+		const double total_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_time).count();
+
+		// Report results in the order of the input files, so that the output does not depend on which thread finished first
+		std::string all_errors;
+		size_t num_failed = 0;
+		for (size_t i = 0; i < source_files.size(); ++i)
+		{
+			if (!results[i])
+			{
+				all_errors += "error: " + source_files[i].u8string() + ": compilation failed\n";
+				num_failed++;
+			}
+
+			all_errors += errors[i];
+		}
+
+		bool cache_written = true;
+		if (cache != nullptr && !(cache_written = cache->flush()))
+			all_errors += "error: Failed to write effect cache archive '" + std::string(cache_file) + "'\n";
+
+		if (error_file == nullptr)
+			std::cout << all_errors << source_files.size() - num_failed << " of " << source_files.size() << " effect files compiled successfully" << std::endl;
+		else
+			std::ofstream(error_file) << all_errors;
+
+		std::vector<std::string> source_file_names;
+		source_file_names.reserve(source_files.size());
+		for (const std::filesystem::path &source_file_path : source_files)
+			source_file_names.push_back(source_file_path.u8string());
+
+		if (time_report)
+		{
+			for (size_t i = 0; i < source_files.size(); ++i)
+				print_time_report(std::cerr, source_file_names[i], timings[i]);
+
+			std::cerr << "total: " << total_milliseconds << " ms wall time for " << source_files.size() << " effect files, " << peak_memory_usage() / (1024 * 1024) << " MiB peak memory usage" << std::endl;
+		}
+		if (time_report_file != nullptr)
+		{
+			std::ofstream time_report_stream(time_report_file);
+			write_time_report_json(time_report_stream, source_file_names, timings, total_milliseconds);
+		}
+
+		return num_failed == 0 && cache_written ? 0 : 1;
+	}
+
 	if (source_file == nullptr || (generate_glsl && (generate_dxbc || generate_hlsl)) || (generate_dxbc && entry_point_name == nullptr) || (output_file == nullptr && (!generate_hlsl && !generate_glsl)))
 	{
 		print_usage(argv[0]);
 		return 1;
 	}
 
-	pp.add_macro_definition("__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION));
-	pp.add_macro_definition("__RESHADE_PERFORMANCE_MODE__", "0");
-	pp.add_macro_definition("BUFFER_WIDTH", buffer_width);
-	pp.add_macro_definition("BUFFER_HEIGHT", buffer_height);
-	pp.add_macro_definition("BUFFER_RCP_WIDTH", "(1.0 / BUFFER_WIDTH)");
-	pp.add_macro_definition("BUFFER_RCP_HEIGHT", "(1.0 / BUFFER_HEIGHT)");
+	std::vector<phase_timing> timings;
+	const std::chrono::high_resolution_clock::time_point start_time = std::chrono::high_resolution_clock::now();
+
+	// Report timings on every exit path below, including failures, since those can be just as slow
+	const auto report_timings = [&]() {
+		const double total_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_time).count();
+
+		if (time_report)
+			print_time_report(std::cerr, source_file, timings);
+		if (time_report_file != nullptr)
+		{
+			std::ofstream time_report_stream(time_report_file);
+			write_time_report_json(time_report_stream, { source_file }, { timings }, total_milliseconds);
+		}
+	};
 
-	if (!pp.append_file(source_file))
+	reshadefx::preprocessor pp;
+	prepare_preprocessor(pp, options);
+
+	bool preprocessed = false;
+	{ const scoped_phase_timer timer(timings, "preprocess");
+		preprocessed = pp.append_file(source_file);
+	}
+
+	if (!preprocessed)
 	{
+		report_timings();
+
 		if (error_file == nullptr)
 			std::cout << pp.errors() << std::endl;
 		else
@@ -208,19 +725,26 @@ int main(int argc, char *argv[])
 
 	std::unique_ptr<reshadefx::codegen> backend;
 	if (generate_dxbc)
-		backend.reset(reshadefx::create_codegen_dxbc(shader_model, debug_info, spec_constants, optimization_level));
+		backend.reset(create_codegen(compile_target::dxbc, options));
 	else if (generate_hlsl)
-		backend.reset(reshadefx::create_codegen_hlsl(shader_model, debug_info, spec_constants));
+		backend.reset(create_codegen(compile_target::hlsl, options));
 	else if (generate_glsl)
-		backend.reset(reshadefx::create_codegen_glsl(vulkan_semantics, debug_info, spec_constants, invert_y_axis));
+		backend.reset(create_codegen(compile_target::glsl, options));
 	else if (generate_spirv)
-		backend.reset(reshadefx::create_codegen_spirv(vulkan_semantics, debug_info, spec_constants, invert_y_axis));
+		backend.reset(create_codegen(compile_target::spirv, options));
 	else
 		return 1;
 
 	reshadefx::parser parser;
-	if (!parser.parse(pp.output(), backend.get()))
+	bool parsed = false;
+	{ const scoped_phase_timer timer(timings, "parse");
+		parsed = parser.parse(pp.output(), backend.get());
+	}
+
+	if (!parsed)
 	{
+		report_timings();
+
 		if (error_file == nullptr)
 			std::cout << pp.errors() << parser.errors() << std::endl;
 		else
@@ -232,8 +756,15 @@ int main(int argc, char *argv[])
 	if (entry_point_name != nullptr)
 	{
 		std::basic_string<char> assembly, errors;
-		if (!backend->assemble_code_for_entry_point(entry_point_name, code, assembly, errors))
+		bool assembled = false;
+		{ const scoped_phase_timer timer(timings, std::string("assemble ") + entry_point_name);
+			assembled = backend->assemble_code_for_entry_point(entry_point_name, code, assembly, errors);
+		}
+
+		if (!assembled)
 		{
+			report_timings();
+
 			if (error_file == nullptr)
 				std::cout << pp.errors() << parser.errors() << errors << std::endl;
 			else
@@ -243,9 +774,12 @@ int main(int argc, char *argv[])
 	}
 	else
 	{
+		const scoped_phase_timer timer(timings, "finalize");
 		code = backend->finalize_code();
 	}
 
+	report_timings();
+
 	if (output_file != nullptr)
 	{
 		std::ofstream(output_file, std::ios::binary).write(code.data(), code.size());